@@ -12,12 +12,27 @@
 #ifdef WIN64
     #include <windows.h>
 #else
-    #include <sys/time.h>
+    #include <time.h>
+    #include <pthread.h>
+    #include <unistd.h>
+#endif
+#if defined(USE_PEXT) || defined(USE_AVX2)
+    #include <immintrin.h>
 #endif
 
 // define bitboard data type
 #define U64 unsigned long long
 
+// force inlining of side specialized function bodies (side argument folds into a compile time constant)
+#define force_inline static inline __attribute__((always_inline))
+
+// attack tables & hash keys are read only & initialized from generated attack_tables.h when precomputed
+#ifdef PRECOMPUTED_TABLES
+    #define table_const const
+#else
+    #define table_const
+#endif
+
 // FEN dedug positions
 #define empty_board "8/8/8/8/8/8/8/8 b - - "
 #define start_position "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1 "
@@ -38,7 +53,7 @@ enum {
 };
 
 // encode pieces
-enum { P, N, B, R, Q, K, p, n, b, r, q, k };
+enum { P, N, B, R, Q, K, p, n, b, r, q, k, no_piece };
 
 // enum sides to moves (colors)
 enum { white, black, both};
@@ -217,68 +232,166 @@ char promoted_pieces[] = {
 
 */
 
-// piece bitboards
-U64 bitboards[12];
+// maximum number of plies the undo stack can hold (game moves + search depth)
+// callers must keep moves made since parse_fen (game history plus the deepest perft/search line) below max_ply,
+// make_move doesn't check it (DEBUG builds abort on overflow)
+#define max_ply 1024
 
-// occupancy bitboards
-U64 occupancies[3];
+// undo record (irreversible state that unmake_move can't derive from the move itself)
+typedef struct {
+    // hash key before the move
+    U64 hash_key;
 
-// side to move
-int side;
+    // captured piece (no_piece if none)
+    unsigned char captured;
 
-// enpassant square
-int enpassant = no_sq;
+    // castling rights before the move
+    unsigned char castle;
 
-// castling rights
-int castle;
+    // enpassant square before the move
+    unsigned char enpassant;
+} undo;
 
-/*************************************************\
-===================================================
-                PRNG / Magic Numbers
-===================================================
-\*************************************************/
+// board state (position) structure
+typedef struct {
+#ifdef QUAD_BITBOARDS
+    // bit-sliced piece codes (bits 0-2: piece type 1..6, bit 3: black), empty squares are 0 in all 4 boards
+    U64 quad[4];
+#else
+    // piece bitboards
+    U64 bitboards[12];
 
-//  pseudo random number state
-unsigned int random_state = 1804289383;
+    // occupancy bitboards
+    U64 occupancies[3];
+#endif
 
-// generate 32-bit pseudo legal numbers
-unsigned int get_random_U32_number() {
+    // side to move
+    int side;
 
-    // get current state
-    unsigned int number = random_state;
+    // enpassant square
+    int enpassant;
 
-    // XOR shift algorithm
-    number ^= number << 13;
-    number ^= number >> 17;
-    number ^= number << 5;
+    // castling rights
+    int castle;
 
-    // update random number sate
-    random_state = number;
+    // piece on square lookup (mailbox) kept in sync with piece bitboards
+    unsigned char mailbox[64];
 
-    // return random number
-    return number;
+    // "almost" unique position identifier aka hash key or position key
+    U64 hash_key;
+
+#ifdef ATTACK_BOARDS
+    // squares attacked by the piece standing on square [square]
+    U64 attacks_from[64];
+
+    // pieces attacking square [square]
+    U64 attacks_to[64];
+#endif
+
+#ifdef MAKE_UNMAKE
+    // current ply (index of the next free undo record)
+    int ply;
+
+    // ply indexed undo stack used by unmake_move
+    undo undo_stack[max_ply];
+#endif
+} position;
+
+#ifdef QUAD_BITBOARDS
+
+/*
+    Quad bitboards store the 4 bit piece code of every square bit-sliced
+    over 4 bitboards instead of keeping one bitboard per piece:
+
+        P N B R Q K  ->  0001 0010 0011 0100 0101 0110
+        p n b r q k  ->  1001 1010 1011 1100 1101 1110
+
+    piece bitboards are extracted by matching all 4 slices, occupancies
+    are derived (any of the type slices for both sides, color slice for black)
+*/
+
+// get piece bitboard (piece type & color slices match the piece code)
+force_inline U64 get_bitboard(const position *pos, int piece) {
+    int type = piece % 6 + 1;
+
+    return ((type & 1) ? pos->quad[0] : ~pos->quad[0]) &
+           ((type & 2) ? pos->quad[1] : ~pos->quad[1]) &
+           ((type & 4) ? pos->quad[2] : ~pos->quad[2]) &
+           ((piece >= p) ? pos->quad[3] : ~pos->quad[3]);
 }
 
-// generate 64-bit pseudo legal numbers
-U64 get_random_U64_numbers() {
+// get occupancy bitboard
+force_inline U64 get_occupancy(const position *pos, int side) {
+    U64 occupancy = pos->quad[0] | pos->quad[1] | pos->quad[2];
+
+    return (side == both) ? occupancy : (side == black) ? pos->quad[3] : occupancy & ~pos->quad[3];
+}
+
+// put piece on empty square
+force_inline void set_piece(position *pos, int piece, int square) {
+    U64 code = (piece % 6 + 1) | ((piece >= p) << 3);
 
-    // define 4 random numbers
-    U64 n1, n2, n3, n4;
+    pos->quad[0] |= (code & 1) << square;
+    pos->quad[1] |= ((code >> 1) & 1) << square;
+    pos->quad[2] |= ((code >> 2) & 1) << square;
+    pos->quad[3] |= ((code >> 3) & 1) << square;
+}
 
-    // init random numbers slicing 16bits from MS1B side
-    n1 = (U64)(get_random_U32_number()) & 0xFFFF;
-    n2 = (U64)(get_random_U32_number()) & 0xFFFF;
-    n3 = (U64)(get_random_U32_number()) & 0xFFFF;
-    n4 = (U64)(get_random_U32_number()) & 0xFFFF;
+// remove piece from square (clears the square whatever piece is standing on it)
+force_inline void pop_piece(position *pos, int piece, int square) {
+    (void)piece;
+    U64 mask = ~(1ULL << square);
 
-    // return random number
-    return n1 | (n2 << 16) | (n3 << 32) | (n4 << 48);
+    pos->quad[0] &= mask;
+    pos->quad[1] &= mask;
+    pos->quad[2] &= mask;
+    pos->quad[3] &= mask;
 }
 
-// generate magic number candidate
-U64 generate_magic_number () {
-    // return magic numbers
-    return get_random_U64_numbers() & get_random_U64_numbers() & get_random_U64_numbers();
+// occupancies are derived from quad bitboards, nothing to update
+#define toggle_occupancy(pos, side, mask) ((void)(mask))
+
+#else
+
+// get piece bitboard
+#define get_bitboard(pos, piece) ((pos)->bitboards[(piece)])
+
+// get occupancy bitboard
+#define get_occupancy(pos, side) ((pos)->occupancies[(side)])
+
+// put piece on square / remove piece from square
+#define set_piece(pos, piece, square) set_bit((pos)->bitboards[(piece)], (square))
+#define pop_piece(pos, piece, square) pop_bit((pos)->bitboards[(piece)], (square))
+
+// toggle squares in side & both occupancies
+#define toggle_occupancy(pos, side, mask) ((pos)->occupancies[(side)] ^= (mask), (pos)->occupancies[both] ^= (mask))
+
+#endif
+
+#ifdef ATTACK_BOARDS
+// init attack boards from scratch (see Attack Boards)
+void init_attack_boards(position *pos);
+#endif
+
+/*************************************************\
+===================================================
+                PRNG / Magic Numbers
+===================================================
+\*************************************************/
+
+//  pseudo random number state
+U64 random_state = 1804289383;
+
+// generate 64-bit pseudo random numbers (xorshift64*, multiplication keeps keys linearly independent)
+U64 get_random_U64_numbers() {
+
+    // XOR shift algorithm
+    random_state ^= random_state >> 12;
+    random_state ^= random_state << 25;
+    random_state ^= random_state >> 27;
+
+    // return scrambled state
+    return random_state * 2685821657736338717ULL;
 }
 
 /*************************************************\
@@ -293,6 +406,27 @@ U64 generate_magic_number () {
 #define pop_bit(bitboard, square) ((bitboard) &= ~(1ULL << (square)))
 // #define pop_bit(bitboard, square) (get_bit(bitboard, square) ? bitboard ^= (1ULL << square) : 0)
 
+// pop least significant 1st bit (single BLSR instruction when built with BMI)
+#define pop_ls1b(bitboard) ((bitboard) &= (bitboard) - 1)
+
+#ifdef USE_POPCNT
+
+// count active bits within a bitboard (POPCNT instruction when built with -mpopcnt)
+static inline int count_bits(U64 bitboard) {
+
+    // return bit count
+    return __builtin_popcountll(bitboard);
+}
+
+// get least significant 1st bit index (TZCNT instruction when built with -mbmi)
+static inline int get_ls1b_index(U64 bitboard) {
+
+    // make sure bitboard is not 0!! (return illegal index otherwise)
+    return bitboard ? __builtin_ctzll(bitboard) : -1;
+}
+
+#else
+
 // count active bits within a bitboard
 static inline int count_bits(U64 bitboard) {
     
@@ -331,6 +465,8 @@ static inline int get_ls1b_index(U64 bitboard) {
     
 }
 
+#endif
+
 
 // print bitboard
 void print_bitboard(U64 bitboard) {
@@ -369,8 +505,115 @@ void print_bitboard(U64 bitboard) {
    
 }
 
+/*************************************************\
+===================================================
+                Zobrist Hashing
+===================================================
+\*************************************************/
+
+// random piece keys [piece][square]
+table_const U64 piece_keys[12][64];
+
+// random enpassant keys [square]
+table_const U64 enpassant_keys[64];
+
+// random castling keys
+table_const U64 castle_keys[16];
+
+// random side key
+table_const U64 side_key;
+
+#ifndef PRECOMPUTED_TABLES
+
+// init random hash keys
+void init_random_keys() {
+
+    // update pseudo random number state
+    random_state = 1804289383;
+
+    // loop over piece codes
+    for (int piece = P; piece <= k; piece++)
+    {
+        // loop over board squares
+        for (int square = 0; square < 64; square++)
+        {
+            // init random piece keys
+            piece_keys[piece][square] = get_random_U64_numbers();
+        }
+    }
+
+    // loop over board squares
+    for (int square = 0; square < 64; square++)
+    {
+        // init random enpassant keys
+        enpassant_keys[square] = get_random_U64_numbers();
+    }
+
+    // loop over castling keys
+    for (int index = 0; index < 16; index++)
+    {
+        // init castling keys
+        castle_keys[index] = get_random_U64_numbers();
+    }
+
+    // init random side key
+    side_key = get_random_U64_numbers();
+}
+
+#endif
+
+// generate "almost" unique position ID aka hash key from scratch
+U64 generate_hash_key(position *pos) {
+
+    // final hash key
+    U64 final_key = 0ULL;
+
+    // temp piece bitboard copy
+    U64 bitboard;
+
+    // loop over piece bitboards
+    for (int piece = P; piece <= k; piece++)
+    {
+        // init piece bitboard copy
+        bitboard = get_bitboard(pos, piece);
+
+        // loop over the pieces within a bitboard
+        while (bitboard)
+        {
+            // init square occupied by the piece
+            int square = get_ls1b_index(bitboard);
+
+            // hash piece
+            final_key ^= piece_keys[piece][square];
+
+            // pop LS1B
+            pop_ls1b(bitboard);
+        }
+    }
+
+    // if enpassant square is on board
+    if (pos->enpassant != no_sq)
+        // hash enpassant
+        final_key ^= enpassant_keys[pos->enpassant];
+
+    // hash castling rights
+    final_key ^= castle_keys[pos->castle];
+
+    // hash the side only if black is to move
+    if (pos->side == black) final_key ^= side_key;
+
+    // return generated hash key
+    return final_key;
+}
+
+/*************************************************\
+===================================================
+                Print Board / Parse FEN
+===================================================
+\*************************************************/
+
 // print board
-void print_board() {
+void print_board(position *pos) {
 
     // loop over board ranks
     for (int rank = 0; rank < 8; rank++)
@@ -387,25 +630,14 @@ void print_board() {
                 printf("  %d  ", 8 - rank);
             }
 
-            // define piece variable
-            int piece = -1;
+            // lookup piece on current square
+            int piece = pos->mailbox[square];
 
-            // loop over all pieces bitboards
-            for (int bb_piece = P; bb_piece <= k; bb_piece++)
-            {
-                // if there is a piece on current square
-                if (get_bit(bitboards[bb_piece], square))
-                {
-                    // get piece code
-                    piece = bb_piece;
-                }
-                
-            }
             // print different piece set depending on OS
             #ifdef WIN64
-                printf(" %c", (piece == -1) ? '.' : ascii_pieces[piece]);
+                printf(" %c", (piece == no_piece) ? '.' : ascii_pieces[piece]);
             #else
-                printf(" %s", (piece == -1) ? "." : unicode_pieces[piece]);
+                printf(" %s", (piece == no_piece) ? "." : unicode_pieces[piece]);
             #endif
         }
         // print new line every rank
@@ -418,30 +650,46 @@ void print_board() {
     printf("\n      a b c d e f g h\n\n");
     
     // print side to move
-    printf("      Side:     %s\n", !side ? "white" : "black");
+    printf("      Side:     %s\n", !pos->side ? "white" : "black");
     
     // print enpassant square
-    printf("      Enpassant:   %s\n", (enpassant != no_sq) ? square_to_coordinates[enpassant] : "no");
+    printf("      Enpassant:   %s\n", (pos->enpassant != no_sq) ? square_to_coordinates[pos->enpassant] : "no");
     
     // print castling rights
-    printf("      Castling:  %c%c%c%c\n\n", (castle & wk) ? 'K' : '-',
-                                           (castle & wq) ? 'Q' : '-',
-                                           (castle & bk) ? 'k' : '-',
-                                           (castle & bq) ? 'q' : '-');
+    printf("      Castling:  %c%c%c%c\n", (pos->castle & wk) ? 'K' : '-',
+                                         (pos->castle & wq) ? 'Q' : '-',
+                                         (pos->castle & bk) ? 'k' : '-',
+                                         (pos->castle & bq) ? 'q' : '-');
+
+    // print hash key
+    printf("      Hash key:  %llx\n\n", pos->hash_key);
 }
 
 // parse FEN string
-void parse_fen(char *fen) {
+void parse_fen(position *pos, char *fen) {
+#ifdef QUAD_BITBOARDS
+    // reset board position (quad bitboards, occupancies are derived from them)
+    memset(pos->quad, 0ULL, sizeof(pos->quad));
+#else
     // reset board position (bitboards)
-    memset(bitboards, 0ULL, sizeof(bitboards));
+    memset(pos->bitboards, 0ULL, sizeof(pos->bitboards));
 
     // reset occupancies (bitboard)
-    memset(occupancies, 0ULL, sizeof(occupancies));
+    memset(pos->occupancies, 0ULL, sizeof(pos->occupancies));
+#endif
+
+    // reset mailbox (empty squares)
+    memset(pos->mailbox, no_piece, sizeof(pos->mailbox));
 
     // reset game state state variables
-    side = 0;
-    enpassant = no_sq;
-    castle = 0;
+    pos->side = 0;
+    pos->enpassant = no_sq;
+    pos->castle = 0;
+
+#ifdef MAKE_UNMAKE
+    // reset undo stack
+    pos->ply = 0;
+#endif
 
     // loop over board ranks
     for (int rank = 0; rank < 8; rank++)
@@ -458,7 +706,10 @@ void parse_fen(char *fen) {
                 int piece = char_pieces[*fen];
 
                 // set piece on corresponding bitboard
-                set_bit(bitboards[piece], square);
+                set_piece(pos, piece, square);
+
+                // set piece on mailbox
+                pos->mailbox[square] = piece;
 
                 // increment pointer to FEN string
                 fen++;
@@ -481,23 +732,8 @@ void parse_fen(char *fen) {
                 
                 */
 
-                // define piece variable
-                int piece = -1;
-
-                // loop over all pieces bitboards
-                for (int bb_piece = P; bb_piece <= k; bb_piece++)
-                {
-                    // if there is a piece on current square
-                    if (get_bit(bitboards[bb_piece], square))
-                    {
-                        // get piece code
-                        piece = bb_piece;
-                    }
-                    
-                }
-
                 // if there are no previous pieces, 
-                if (piece == -1)
+                if (pos->mailbox[square] == no_piece)
                 {
                     // decrement file to not exceed 7 and move to new rows/rank
                     file--;
@@ -527,7 +763,7 @@ void parse_fen(char *fen) {
     fen++;
 
     // parse side to move
-    (*fen == 'w') ? (side = white) : (side = black);
+    (*fen == 'w') ? (pos->side = white) : (pos->side = black);
 
     // go to parsing castling rights
     fen += 2;
@@ -537,10 +773,10 @@ void parse_fen(char *fen) {
     {
         switch (*fen)
         {
-        case 'K': castle |= wk; break;
-        case 'Q': castle |= wq; break;
-        case 'k': castle |= bk; break;
-        case 'q': castle |= bq; break;
+        case 'K': pos->castle |= wk; break;
+        case 'Q': pos->castle |= wq; break;
+        case 'k': pos->castle |= bk; break;
+        case 'q': pos->castle |= bq; break;
         case '-': break;
         }
 
@@ -559,31 +795,41 @@ void parse_fen(char *fen) {
         int rank = 8 - (fen[1] - '0');
 
         // int enpassant square
-        enpassant = rank * 8 + file;
+        pos->enpassant = rank * 8 + file;
     } 
     // no enpassant square
     else
     {
-        enpassant = no_sq;
+        pos->enpassant = no_sq;
     }
     
+#ifndef QUAD_BITBOARDS
     // loop over white pieces bitboards
     for (int piece = P; piece <= K; piece++)
     {
         // populate white occupancies bitboard
-        occupancies[white] |= bitboards[piece];
+        pos->occupancies[white] |= pos->bitboards[piece];
     }
 
     // loop over black pieces bitboards
     for (int piece = p; piece <= k; piece++)
     {
         // populate white occupancies bitboard
-        occupancies[black] |= bitboards[piece];
+        pos->occupancies[black] |= pos->bitboards[piece];
     }
 
     // init all occupancies
-    occupancies[both] |= occupancies[white];
-    occupancies[both] |= occupancies[black];
+    pos->occupancies[both] |= pos->occupancies[white];
+    pos->occupancies[both] |= pos->occupancies[black];
+#endif
+
+    // init hash key
+    pos->hash_key = generate_hash_key(pos);
+
+#ifdef ATTACK_BOARDS
+    // init attack boards
+    init_attack_boards(pos);
+#endif
 
     // debug FEN
     //printf("fen: %s\n", fen);
@@ -671,25 +917,64 @@ const U64 not_h_file = 9187201950435737471ULL;
 
 
 // pawn attacks table [side][square]
-U64 pawn_attacks[2][64];
+table_const U64 pawn_attacks[2][64];
 
 // knight attacks table [square]
-U64 knight_attacks[64];
+table_const U64 knight_attacks[64];
 
 // king attacks table;
-U64 king_attacks[64];
+table_const U64 king_attacks[64];
+
+// slider attack lookup entry (everything a lookup touches for one square, two entries per cache line)
+typedef struct __attribute__((aligned(32))) {
+    // relevant occupancy mask
+    U64 mask;
+
+    // magic number
+    U64 magic;
+
+    // square's slice of the shared attacks table
+    const U64 *attacks;
+
+    // 64 - magic index bit count
+    int shift;
+} magic_entry;
+
+#ifdef HYPERBOLA_QUINTESSENCE
+
+// diagonal, anti diagonal & file through square (square itself excluded) [square]
+table_const U64 diagonal_masks[64];
+table_const U64 anti_diagonal_masks[64];
+table_const U64 file_masks[64];
+
+// rank 8 attacks [file][inner 6 bits of rank occupancy] (shifted to any other rank)
+table_const unsigned char rank_attacks[8][64];
+
+#else
+
+// bishop & rook lookup entries [square]
+table_const magic_entry bishop_magics[64];
+table_const magic_entry rook_magics[64];
 
-// bishop attack masks
-U64 bishop_masks[64];
+// shared attacks table sizes (sum of 2^index bits over all squares)
+#define bishop_attacks_size 5248
+#define rook_attacks_size 102400
 
-// rook attack masks
-U64 rook_masks[64];
+// PEXT indexes all relevant occupancy bits, so it can't use slices shrunk by magic index reduction
+#if defined(USE_PEXT) && (bishop_attacks_size != 5248 || rook_attacks_size != 102400)
+    #error "USE_PEXT requires full size attack tables (search magics without index reduction)"
+#endif
+
+// shared slider attacks table (bishop slices first, rook slices after, ~840 KB total)
+table_const U64 slider_attacks[bishop_attacks_size + rook_attacks_size];
+
+#endif
 
-// bishop attacks table [square][occupancies]
-U64 bishop_attacks[64][512];
+// squares strictly between two aligned squares [square][square]
+table_const U64 between_masks[64][64];
 
-// rook attacks table [square][occupancies]
-U64 rook_attacks[64][4096];
+// full board line through two aligned squares [square][square]
+table_const U64 line_masks[64][64];
 
 // bishop relevant occupancy bit count for every square on board
 const int bishop_relevant_bits[64] = {
@@ -715,6 +1000,30 @@ const int rook_relevant_bits[64] = {
     12, 11, 11, 11, 11, 11, 11, 12
 };
 
+// bishop magic index bit count for every square on board (relevant bits unless the magic search reduced them)
+int bishop_index_bits[64] = {
+    6, 5, 5, 5, 5, 5, 5, 6, 
+    5, 5, 5, 5, 5, 5, 5, 5, 
+    5, 5, 7, 7, 7, 7, 5, 5, 
+    5, 5, 7, 9, 9, 7, 5, 5, 
+    5, 5, 7, 9, 9, 7, 5, 5, 
+    5, 5, 7, 7, 7, 7, 5, 5, 
+    5, 5, 5, 5, 5, 5, 5, 5, 
+    6, 5, 5, 5, 5, 5, 5, 6
+};
+
+// rook magic index bit count for every square on board (relevant bits unless the magic search reduced them)
+int rook_index_bits[64] = {
+    12, 11, 11, 11, 11, 11, 11, 12, 
+    11, 10, 10, 10, 10, 10, 10, 11, 
+    11, 10, 10, 10, 10, 10, 10, 11, 
+    11, 10, 10, 10, 10, 10, 10, 11, 
+    11, 10, 10, 10, 10, 10, 10, 11, 
+    11, 10, 10, 10, 10, 10, 10, 11, 
+    11, 10, 10, 10, 10, 10, 10, 11, 
+    12, 11, 11, 11, 11, 11, 11, 12
+};
+
 // rook magic numbers
 U64 rook_magic_numbers[64] = {
     0x8a80104000800020ULL,
@@ -1136,6 +1445,8 @@ U64 queen_attacks_on_the_fly(int square, U64 block) {
 
 
 
+#ifndef PRECOMPUTED_TABLES
+
 // init leaper pieces attacks
 void init_leapers_attacks() {
 
@@ -1162,6 +1473,59 @@ void init_leapers_attacks() {
     
 }
 
+#endif
+
+#ifndef PRECOMPUTED_TABLES
+
+// init between & line masks
+void init_line_masks() {
+
+    // loop over source squares
+    for (int source_square = 0; source_square < 64; source_square++)
+    {
+        // loop over target squares
+        for (int target_square = 0; target_square < 64; target_square++)
+        {
+            // reset masks
+            between_masks[source_square][target_square] = 0ULL;
+            line_masks[source_square][target_square] = 0ULL;
+
+            // skip same square
+            if (source_square == target_square) continue;
+
+            // init squares bitboards
+            U64 source = 1ULL << source_square;
+            U64 target = 1ULL << target_square;
+
+            // squares are on the same diagonal
+            if (bishop_attacks_on_the_fly(source_square, 0ULL) & target)
+            {
+                // init line through both squares (empty board rays crossing each other)
+                line_masks[source_square][target_square] = (bishop_attacks_on_the_fly(source_square, 0ULL) &
+                                                            bishop_attacks_on_the_fly(target_square, 0ULL)) | source | target;
+
+                // init squares in between (rays blocked by each other)
+                between_masks[source_square][target_square] = bishop_attacks_on_the_fly(source_square, target) &
+                                                              bishop_attacks_on_the_fly(target_square, source);
+            }
+
+            // squares are on the same rank or file
+            if (rook_attacks_on_the_fly(source_square, 0ULL) & target)
+            {
+                // init line through both squares (empty board rays crossing each other)
+                line_masks[source_square][target_square] = (rook_attacks_on_the_fly(source_square, 0ULL) &
+                                                            rook_attacks_on_the_fly(target_square, 0ULL)) | source | target;
+
+                // init squares in between (rays blocked by each other)
+                between_masks[source_square][target_square] = rook_attacks_on_the_fly(source_square, target) &
+                                                              rook_attacks_on_the_fly(target_square, source);
+            }
+        }
+    }
+}
+
+#endif
+
 // set occupancies
 U64 set_occupancy(int index, int bits_in_mask, U64 attack_mask) {
 
@@ -1175,7 +1539,7 @@ U64 set_occupancy(int index, int bits_in_mask, U64 attack_mask) {
         int square = get_ls1b_index(attack_mask);
 
         // pop LS1B in attack map
-        pop_bit(attack_mask,square);
+        pop_ls1b(attack_mask);
 
         // make sure occupancy is on board
         if (index & (1 << count))
@@ -1192,216 +1556,506 @@ U64 set_occupancy(int index, int bits_in_mask, U64 attack_mask) {
 
 /*************************************************\
 ===================================================
-                Magics Numbers
+                Threads
 ===================================================
 \*************************************************/
 
-// find appropriate magic number
-U64 find_magic_number(int square, int relevant_bits, int bishop) {
+// max threads used by multithreaded tools
+#define max_threads 256
 
-    // init occupancies
-    U64 occupancies[4096];
-
-    // init attack tables
-    U64 attacks[4096];
+#ifdef WIN64
+    // thread handle (started 0: function already ran inline) & entry point type
+    typedef struct { HANDLE handle; int started; } thread_handle;
+    typedef DWORD (WINAPI *thread_entry)(LPVOID);
 
-    // init used attacks
-    U64 used_attacks[4096];
+    // define thread entry point
+    #define thread_function(name) DWORD WINAPI name(LPVOID argument)
+#else
+    // thread handle (started 0: function already ran inline) & entry point type
+    typedef struct { pthread_t handle; int started; } thread_handle;
+    typedef void *(*thread_entry)(void *);
 
-    // init attack mask for a current piece
-    U64 attack_mask = bishop ? mask_bishop_attacks(square) : mask_rook_attacks(square);
+    // define thread entry point
+    #define thread_function(name) void *name(void *argument)
+#endif
 
-    // init occupancy indices
-    int occupancy_indicies = 1 << relevant_bits;
+// start thread running function(argument) (runs it inline if thread can't be created, so no jobs are dropped)
+void thread_start(thread_handle *thread, thread_entry function, void *argument) {
+#ifdef WIN64
+    thread->handle = CreateThread(NULL, 0, function, argument, 0, NULL);
+    thread->started = thread->handle != NULL;
+#else
+    thread->started = pthread_create(&thread->handle, NULL, function, argument) == 0;
+#endif
 
-    // loop over occupancy indices
-    for (int index = 0; index < occupancy_indicies; index++)
+    // thread creation failed
+    if (!thread->started)
     {
-        // init occupancies
-        occupancies[index] = set_occupancy(index, relevant_bits, attack_mask);
-
-        // init attacks
-        attacks[index] = bishop ? bishop_attacks_on_the_fly(square, occupancies[index]) : rook_attacks_on_the_fly(square, occupancies[index]);
+        printf("     Thread: failed to start, running its work on the calling thread\n");
+        function(argument);
     }
+}
 
-    // test magic numbers loop
-    for (int random_count = 0; random_count < 100000000; random_count++)
-    {
-        // generate magic number candidate
-        U64 magic_number = generate_magic_number();
-
-        // skip inappropriate magic numbers
-        if (count_bits((attack_mask * magic_number) & 0xFF00000000000000) < 6) continue;
-        
-        // init used attacks
-        memset(used_attacks, 0ULL, sizeof(used_attacks));
+// wait for thread to finish
+void thread_join(thread_handle thread) {
 
-        // init index & fail flag
-        int index, fail;
+    // function already ran inline
+    if (!thread.started) return;
 
-        // test magic index
-        for (index = 0, fail = 0; !fail && index < occupancy_indicies; index++)
-        {
-            // init magic index
-            int magic_index = (int)((occupancies[index] * magic_number) >> (64 - relevant_bits));
+#ifdef WIN64
+    WaitForSingleObject(thread.handle, INFINITE);
+    CloseHandle(thread.handle);
+#else
+    pthread_join(thread.handle, NULL);
+#endif
+}
 
-            // if magic index works
-            if (used_attacks[magic_index] == 0ULL)
-            {
-                // init used attacks
-                used_attacks[magic_index] = attacks[index];
-            }
-            else if (used_attacks[magic_index] != attacks[index])
-            {
-                fail = 1;
-            }
-        }
+// get number of logical cores
+int get_cpu_count() {
+#ifdef WIN64
+    SYSTEM_INFO system_info;
+    GetSystemInfo(&system_info);
+    return system_info.dwNumberOfProcessors;
+#else
+    return (int)sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+}
 
-        // if magic number works
-        if (!fail)
+/*************************************************\
+===================================================
+                Magics Numbers
+===================================================
+\*************************************************/
+
+// max magic candidates tried per square at its relevant bits & when shrinking the index by one more bit
+#define magic_max_tries 100000000
+#define magic_shrink_tries 10000000
+
+// magic search state (one per thread, heap allocated instead of 3x32 KB stack arrays)
+typedef struct {
+    // occupancy variations & their attacks
+    U64 occupancies[4096];
+    U64 attacks[4096];
+
+    // attacks stored at magic index & candidate epoch they were stored in (older epoch = empty slot)
+    U64 used_attacks[4096];
+    unsigned int used_epochs[4096];
+
+    // current candidate epoch
+    unsigned int epoch;
+
+    // xorshift state (seeded per square & piece so results don't depend on thread scheduling)
+    U64 random_state;
+} magic_search;
+
+// magic search jobs shared by search threads (jobs 0..63 rooks, 64..127 bishops)
+typedef struct {
+    // search seed
+    U64 seed;
+
+    // try index bits down to relevant bits - index_reduction
+    int index_reduction;
+
+    // next job to pick up
+    int next_job;
+
+    // found magics & their index bit counts
+    U64 magic_numbers[128];
+    int index_bits[128];
+} magic_jobs;
+
+// generate magic number candidate (xorshift64*, sparse numbers make better magics at relevant bits)
+static inline U64 generate_magic_number(magic_search *search, int dense) {
+
+    // define 3 random numbers
+    U64 numbers[3];
+
+    // loop over random numbers
+    for (int count = 0; count < 3; count++)
+    {
+        // XOR shift algorithm
+        search->random_state ^= search->random_state >> 12;
+        search->random_state ^= search->random_state << 25;
+        search->random_state ^= search->random_state >> 27;
+        numbers[count] = search->random_state * 2685821657736338717ULL;
+    }
+
+    // return dense or sparse magic number candidate
+    return dense ? numbers[0] : numbers[0] & numbers[1] & numbers[2];
+}
+
+// find magic number mapping square's occupancies into index_bits bits (0 if none found within max_tries)
+U64 find_magic_number(magic_search *search, int square, int index_bits, int bishop, int max_tries) {
+
+    // init attack mask for a current piece
+    U64 attack_mask = bishop ? mask_bishop_attacks(square) : mask_rook_attacks(square);
+
+    // init relevant occupancy bit count
+    int relevant_bits = count_bits(attack_mask);
+
+    // init occupancy indices
+    int occupancy_indicies = 1 << relevant_bits;
+
+    // loop over occupancy indices
+    for (int index = 0; index < occupancy_indicies; index++)
+    {
+        // init occupancies
+        search->occupancies[index] = set_occupancy(index, relevant_bits, attack_mask);
+
+        // init attacks
+        search->attacks[index] = bishop ? bishop_attacks_on_the_fly(square, search->occupancies[index])
+                                        : rook_attacks_on_the_fly(square, search->occupancies[index]);
+    }
+
+    // test magic numbers loop
+    for (int random_count = 0; random_count < max_tries; random_count++)
+    {
+        // generate magic number candidate (reduced index needs constructive collisions sparse numbers hardly ever make)
+        U64 magic_number = generate_magic_number(search, index_bits < relevant_bits);
+
+        // skip inappropriate magic numbers
+        if (count_bits((attack_mask * magic_number) & 0xFF00000000000000) < 6) continue;
+
+        // next epoch empties used attacks (clear epochs only once they wrap around)
+        if (++search->epoch == 0)
+        {
+            memset(search->used_epochs, 0, sizeof(search->used_epochs));
+            search->epoch = 1;
+        }
+
+        // init index & fail flag
+        int index, fail;
+
+        // test magic index
+        for (index = 0, fail = 0; !fail && index < occupancy_indicies; index++)
         {
+            // init magic index
+            int magic_index = (int)((search->occupancies[index] * magic_number) >> (64 - index_bits));
+
+            // if magic index is empty in current epoch
+            if (search->used_epochs[magic_index] != search->epoch)
+            {
+                // init used attacks
+                search->used_epochs[magic_index] = search->epoch;
+                search->used_attacks[magic_index] = search->attacks[index];
+            }
+
+            // destructive collision (constructive ones map to the same attacks)
+            else if (search->used_attacks[magic_index] != search->attacks[index])
+                fail = 1;
+        }
+
+        // if magic number works
+        if (!fail)
             // return it
             return magic_number;
-        }
     }
-    
+
     // if magic number doesnt work
-    printf("  Magic Number Fails!\n");
     return 0ULL;
-    
 }
 
-// init magic numbers
-void init_magic_numbers() {
+// magic search thread (picks up square/piece jobs until none are left)
+thread_function(magic_search_thread) {
 
-    // loop over 64 board squares
+    // init shared jobs
+    magic_jobs *jobs = (magic_jobs *)argument;
+
+    // init thread's search state
+    magic_search *search = calloc(1, sizeof(magic_search));
+
+    // pick up next job
+    int job;
+    while ((job = __atomic_fetch_add(&jobs->next_job, 1, __ATOMIC_RELAXED)) < 128)
+    {
+        // init square & piece
+        int square = job & 63;
+        int bishop = job >= 64;
+
+        // init relevant occupancy bit count
+        int relevant_bits = count_bits(bishop ? mask_bishop_attacks(square) : mask_rook_attacks(square));
+
+        // seed job's random state (splitmix64 of seed & job, never 0)
+        U64 state = jobs->seed + (job + 1) * 0x9E3779B97F4A7C15ULL;
+        state = (state ^ (state >> 30)) * 0xBF58476D1CE4E5B9ULL;
+        state = (state ^ (state >> 27)) * 0x94D049BB133111EBULL;
+        search->random_state = (state ^ (state >> 31)) | 1;
+
+        // find magic number at relevant bits
+        jobs->magic_numbers[job] = find_magic_number(search, square, relevant_bits, bishop, magic_max_tries);
+        jobs->index_bits[job] = relevant_bits;
+
+        // try shrinking index (denser attacks table slice)
+        for (int index_bits = relevant_bits - 1; index_bits >= relevant_bits - jobs->index_reduction; index_bits--)
+        {
+            // find magic number at fewer bits
+            U64 magic_number = find_magic_number(search, square, index_bits, bishop, magic_shrink_tries);
+
+            // no luck, keep previous one
+            if (magic_number == 0ULL) break;
+
+            // keep denser magic number
+            jobs->magic_numbers[job] = magic_number;
+            jobs->index_bits[job] = index_bits;
+        }
+    }
+
+    // free thread's search state
+    free(search);
+
+    return 0;
+}
+
+// print magic search results as ready to paste arrays
+void print_magic_numbers(magic_jobs *jobs, int bishop) {
+
+    // init piece name & first job
+    char *piece = bishop ? "bishop" : "rook";
+    int first_job = bishop ? 64 : 0;
+
+    // init attacks table size
+    int attacks_size = 0;
+
+    // print index bits (relevant occupancy bits stay as they are, shift is 64 - index bits)
+    printf("// %s magic index bit count for every square on board (relevant bits unless the magic search reduced them)\n", piece);
+    printf("int %s_index_bits[64] = {", piece);
+    for (int square = 0; square < 64; square++)
+    {
+        if (square % 8 == 0) printf("\n    ");
+        printf("%d, ", jobs->index_bits[first_job + square]);
+        attacks_size += 1 << jobs->index_bits[first_job + square];
+    }
+    printf("\n};\n\n");
+
+    // print magic numbers
+    printf("// %s magic numbers\n", piece);
+    printf("U64 %s_magic_numbers[64] = {\n", piece);
+    for (int square = 0; square < 64; square++)
+        printf("    0x%llxULL,\n", jobs->magic_numbers[first_job + square]);
+    printf("};\n\n");
+
+    // print attacks table size
+    printf("#define %s_attacks_size %d\n\n", piece, attacks_size);
+}
+
+// search magic numbers for all squares & pieces on threads_count threads, print them & init magic numbers
+void init_magic_numbers(U64 seed, int threads_count, int index_reduction) {
+
+    // init shared jobs
+    static magic_jobs jobs[1];
+    memset(jobs, 0, sizeof(magic_jobs));
+    jobs->seed = seed;
+    jobs->index_reduction = index_reduction;
+
+    // clamp thread count
+    if (threads_count < 1) threads_count = 1;
+    if (threads_count > max_threads) threads_count = max_threads;
+
+    // start search threads & wait for them to finish
+    thread_handle threads[max_threads];
+    for (int thread = 0; thread < threads_count; thread++)
+        thread_start(&threads[thread], magic_search_thread, jobs);
+    for (int thread = 0; thread < threads_count; thread++)
+        thread_join(threads[thread]);
+
+    // report failed searches
+    for (int job = 0; job < 128; job++)
+        if (jobs->magic_numbers[job] == 0ULL)
+            printf("// Magic Number Fails! (%s on square %d)\n", job >= 64 ? "bishop" : "rook", job & 63);
+
+    // init magic numbers & index bits
     for (int square = 0; square < 64; square++)
     {
-        // init rook magic numbers
-        // printf(" 0x%llxULL\n", find_magic_number(square, rook_relevant_bits[square], rook));
-        rook_magic_numbers[square] = find_magic_number(square, rook_relevant_bits[square], rook);
+        rook_magic_numbers[square] = jobs->magic_numbers[square];
+        bishop_magic_numbers[square] = jobs->magic_numbers[64 + square];
+        rook_index_bits[square] = jobs->index_bits[square];
+        bishop_index_bits[square] = jobs->index_bits[64 + square];
     }
 
-    // printf("\n\n");
+    // print ready to paste arrays
+    printf("// magic numbers searched with seed %llu, index reduced by up to %d bits\n\n", seed, index_reduction);
+    print_magic_numbers(jobs, rook);
+    print_magic_numbers(jobs, bishop);
+}
+
+#ifdef HYPERBOLA_QUINTESSENCE
+
+#ifndef PRECOMPUTED_TABLES
+
+// init line masks & rank attacks of hyperbola quintessence
+void init_hyperbola_masks() {
 
     // loop over 64 board squares
     for (int square = 0; square < 64; square++)
     {
-        // init bishop magic numbers
-        // printf(" 0x%llxULL\n", find_magic_number(square, bishop_relevant_bits[square], bishop));
-        bishop_magic_numbers[square] = find_magic_number(square, bishop_relevant_bits[square], bishop);
+        // init square's rank & file
+        int rank = square / 8;
+        int file = square % 8;
+
+        // reset masks
+        diagonal_masks[square] = 0ULL;
+        anti_diagonal_masks[square] = 0ULL;
+        file_masks[square] = 0ULL;
+
+        // loop over other squares
+        for (int target_square = 0; target_square < 64; target_square++)
+        {
+            // skip same square
+            if (target_square == square) continue;
+
+            // init target square's rank & file
+            int target_rank = target_square / 8;
+            int target_file = target_square % 8;
+
+            // target square shares a line with square
+            if (target_rank - target_file == rank - file) set_bit(diagonal_masks[square], target_square);
+            if (target_rank + target_file == rank + file) set_bit(anti_diagonal_masks[square], target_square);
+            if (target_file == file) set_bit(file_masks[square], target_square);
+        }
     }
-    
+
+    // loop over files & inner occupancies of rank 8
+    for (int file = 0; file < 8; file++)
+        for (int occupancy = 0; occupancy < 64; occupancy++)
+            rank_attacks[file][occupancy] = (unsigned char)rook_attacks_on_the_fly(file, (U64)occupancy << 1);
+}
+
+#endif
+
+// get slider attacks along a line holding one square per rank (byte swap mirrors the line, no tables involved)
+static inline U64 get_line_attacks(int square, U64 occupancy, U64 mask) {
+
+    // init slider & line occupancy (forward & mirrored)
+    U64 slider = 1ULL << square;
+    U64 forward = occupancy & mask;
+    U64 reverse = __builtin_bswap64(forward);
+
+    // subtracting the slider borrows up to the nearest blocker in both directions
+    forward -= slider;
+    reverse -= __builtin_bswap64(slider);
+
+    // return attacks in both directions
+    return (forward ^ __builtin_bswap64(reverse)) & mask;
+}
+
+// get slider attacks along square's rank (rank 8 lookup shifted to square's rank)
+static inline U64 get_rank_attacks(int square, U64 occupancy) {
+
+    // init rank shift
+    int shift = square & 56;
+
+    // return rank attacks
+    return (U64)rank_attacks[square & 7][(occupancy >> (shift + 1)) & 63] << shift;
+}
+
+// get bishop attacks
+static inline U64 get_bishop_attacks(int square, U64 occupancy) {
+
+    // return diagonal & anti diagonal attacks
+    return get_line_attacks(square, occupancy, diagonal_masks[square]) |
+           get_line_attacks(square, occupancy, anti_diagonal_masks[square]);
+}
+
+// get rook attacks
+static inline U64 get_rook_attacks(int square, U64 occupancy) {
+
+    // return file & rank attacks
+    return get_line_attacks(square, occupancy, file_masks[square]) | get_rank_attacks(square, occupancy);
+}
+
+#else
+
+// get attack table index of an occupancy within the entry's slice
+static inline unsigned int magic_index(const magic_entry *entry, U64 occupancy) {
+
+#ifdef USE_PEXT
+    // PEXT gathers relevant occupancy bits, no magic number involved
+    return (unsigned int)_pext_u64(occupancy, entry->mask);
+#else
+    // mask relevant occupancy, multiply by magic, keep relevant bits
+    return (unsigned int)(((occupancy & entry->mask) * entry->magic) >> entry->shift);
+#endif
 }
 
+#ifndef PRECOMPUTED_TABLES
+
 // init slider piece's attack tables
 void init_sliders_attacks(int bishop) {
 
+    // init first slice of the shared attacks table (rook slices follow the bishop ones)
+    U64 *slice = bishop ? slider_attacks : slider_attacks + bishop_attacks_size;
+
     // loop over 64 board square
     for (int square = 0; square < 64; square++)
     {
-        // init bishop & rook mask
-        bishop_masks[square] = mask_bishop_attacks(square);
-        rook_masks[square] = mask_rook_attacks(square);
-
-        // init current attack mask
-        U64 attacks_mask = bishop ? bishop_masks[square] : rook_masks[square];
+        // init current lookup entry
+        magic_entry *entry = bishop ? &bishop_magics[square] : &rook_magics[square];
 
         // init relevant occupancy bit count
-        int relevant_bits_count = count_bits(attacks_mask);
-        
+        int relevant_bits_count = bishop ? bishop_relevant_bits[square] : rook_relevant_bits[square];
+
+        // init magic index bit count (PEXT index always spans all relevant bits)
+#ifdef USE_PEXT
+        int index_bits_count = relevant_bits_count;
+#else
+        int index_bits_count = bishop ? bishop_index_bits[square] : rook_index_bits[square];
+#endif
+
+        // init lookup entry
+        entry->mask = bishop ? mask_bishop_attacks(square) : mask_rook_attacks(square);
+        entry->magic = bishop ? bishop_magic_numbers[square] : rook_magic_numbers[square];
+        entry->shift = 64 - index_bits_count;
+        entry->attacks = slice;
+
         // init occupancy indicies
         int occupancy_indicies = (1 << relevant_bits_count);
 
-        // loop over occupancy indicies
+        // loop over all occupancy variations (reduced index makes some of them share a slot)
         for (int index = 0; index < occupancy_indicies; index++)
         {
-            // bishop
-            if (bishop)
-            {
-                // init current occupancy variation
-                U64 occupancy = set_occupancy(index, relevant_bits_count, attacks_mask);
-
-                // init magic index
-                int magic_index = (occupancy * bishop_magic_numbers[square]) >> (64 - bishop_relevant_bits[square]);
-
-                // init bishop attacks
-                bishop_attacks[square][magic_index] = bishop_attacks_on_the_fly(square, occupancy);
-            } 
-            // rook
-            else
-            {
-                // init current occupancy variation
-                U64 occupancy = set_occupancy(index, relevant_bits_count, attacks_mask);
-
-                // init magic index
-                int magic_index = (occupancy * rook_magic_numbers[square]) >> (64 - rook_relevant_bits[square]);
+            // init current occupancy variation
+            U64 occupancy = set_occupancy(index, relevant_bits_count, entry->mask);
 
-                // init rook attacks
-                rook_attacks[square][magic_index] = rook_attacks_on_the_fly(square, occupancy);
-            }
-            
-            
+            // init slider attacks
+            slice[magic_index(entry, occupancy)] = bishop ? bishop_attacks_on_the_fly(square, occupancy)
+                                                          : rook_attacks_on_the_fly(square, occupancy);
         }
-        
+
+        // next square's slice
+        slice += 1 << index_bits_count;
     }
-    
+
 }
 
+#endif
+
 // get bishop attacks
 static inline U64 get_bishop_attacks(int square, U64 occupancy) {
 
-    // get bishop attacks assuming current board occupancy
-    occupancy &= bishop_masks[square];
-    occupancy *= bishop_magic_numbers[square];
-    occupancy >>= 64 - bishop_relevant_bits[square];
+    // init bishop lookup entry
+    const magic_entry *entry = &bishop_magics[square];
 
-    // return bishop attacks
-    return bishop_attacks[square][occupancy];
+    // return bishop attacks assuming current board occupancy
+    return entry->attacks[magic_index(entry, occupancy)];
 }
 
 // get rook attacks
 static inline U64 get_rook_attacks(int square, U64 occupancy) {
 
-    // get rook attacks assuming current board occupancy
-    occupancy &= rook_masks[square];
-    occupancy *= rook_magic_numbers[square];
-    occupancy >>= 64 - rook_relevant_bits[square];
+    // init rook lookup entry
+    const magic_entry *entry = &rook_magics[square];
 
-    // return rook attacks
-    return rook_attacks[square][occupancy];
+    // return rook attacks assuming current board occupancy
+    return entry->attacks[magic_index(entry, occupancy)];
 }
 
+#endif
+
 // get queen attacks
 static inline U64 get_queen_attacks(int square, U64 occupancy) {
 
-    // init result attacks bitboard
-    U64 queen_attacks = 0ULL;
-
-    // init bishop occupancies
-    U64 bishop_occupancy = occupancy;
-
-    // init rook occupancies
-    U64 rook_occupancy = occupancy;
-
-    // get bishop attacks assuming current board occupancy
-    bishop_occupancy &= bishop_masks[square];
-    bishop_occupancy *= bishop_magic_numbers[square];
-    bishop_occupancy >>= 64 - bishop_relevant_bits[square];
-
-    // get bishop attacks
-    queen_attacks = bishop_attacks[square][bishop_occupancy];
-
-    // get rook attacks assuming current board occupancy
-    rook_occupancy &= rook_masks[square];
-    rook_occupancy *= rook_magic_numbers[square];
-    rook_occupancy >>= 64 - rook_relevant_bits[square];
-
-    // get rook attacks
-    queen_attacks |= rook_attacks[square][rook_occupancy];
-
     // return queen attacks consist of both bishop and rooks
-    return queen_attacks;
+    return get_bishop_attacks(square, occupancy) | get_rook_attacks(square, occupancy);
 }
 
 /*************************************************\
@@ -1410,47 +2064,41 @@ static inline U64 get_queen_attacks(int square, U64 occupancy) {
 ===================================================
 \*************************************************/
 
-// is current given square attacked by the current given sides
-static inline int is_square_attacked(int square, int side) {
+// is current given square attacked by the current given sides assuming given occupancy
+force_inline int is_square_attacked_occupancy(position *pos, int square, const int side, U64 occupancy) {
 
     // attacked by white pawn
-    if ((side == white) && (pawn_attacks[black][square] & bitboards[P]))
+    if ((side == white) && (pawn_attacks[black][square] & get_bitboard(pos, P)))
     {
         return 1;
     }
 
     // attacked by black pawn
-    if ((side == black) && (pawn_attacks[white][square] & bitboards[p]))
+    if ((side == black) && (pawn_attacks[white][square] & get_bitboard(pos, p)))
     {
         return 1;
     }
 
     // attacked by knights
-    if (knight_attacks[square] & ((side == white) ? bitboards[N] : bitboards[n]))
+    if (knight_attacks[square] & ((side == white) ? get_bitboard(pos, N) : get_bitboard(pos, n)))
     {
         return 1;
     }
 
-    // attacked by bishops
-    if (get_bishop_attacks(square, occupancies[both]) & ((side == white) ? bitboards[B] : bitboards[b]))
+    // attacked by bishops & queens (queens share bishop & rook lookups)
+    if (get_bishop_attacks(square, occupancy) & ((side == white) ? (get_bitboard(pos, B) | get_bitboard(pos, Q)) : (get_bitboard(pos, b) | get_bitboard(pos, q))))
     {
         return 1;
     }
     
-    // attacked by rooks
-    if (get_rook_attacks(square, occupancies[both]) & ((side == white) ? bitboards[R] : bitboards[r]))
-    {
-        return 1;
-    }
-
-    // attacked by queens
-    if (get_queen_attacks(square, occupancies[both]) & ((side == white) ? bitboards[Q] : bitboards[q]))
+    // attacked by rooks & queens
+    if (get_rook_attacks(square, occupancy) & ((side == white) ? (get_bitboard(pos, R) | get_bitboard(pos, Q)) : (get_bitboard(pos, r) | get_bitboard(pos, q))))
     {
         return 1;
     }
 
     // attacked by kings
-    if (king_attacks[square] & ((side == white) ? bitboards[K] : bitboards[k]))
+    if (king_attacks[square] & ((side == white) ? get_bitboard(pos, K) : get_bitboard(pos, k)))
     {
         return 1;
     }
@@ -1459,8 +2107,38 @@ static inline int is_square_attacked(int square, int side) {
     return 0;
 }
 
+// get pieces of both sides attacking given square assuming given occupancy
+// (pieces missing from occupancy still count as attackers, mask the result with occupancy to drop them)
+static inline U64 attackers_to(position *pos, int square, U64 occupancy) {
+
+    // init bishop & queen, rook & queen bitboards of both sides
+    U64 bishops_queens = get_bitboard(pos, B) | get_bitboard(pos, b) | get_bitboard(pos, Q) | get_bitboard(pos, q);
+    U64 rooks_queens = get_bitboard(pos, R) | get_bitboard(pos, r) | get_bitboard(pos, Q) | get_bitboard(pos, q);
+
+    // return attackers (pawns attack square from the opposite side's pawn attack squares)
+    return (pawn_attacks[black][square] & get_bitboard(pos, P)) |
+           (pawn_attacks[white][square] & get_bitboard(pos, p)) |
+           (knight_attacks[square] & (get_bitboard(pos, N) | get_bitboard(pos, n))) |
+           (king_attacks[square] & (get_bitboard(pos, K) | get_bitboard(pos, k))) |
+           (get_bishop_attacks(square, occupancy) & bishops_queens) |
+           (get_rook_attacks(square, occupancy) & rooks_queens);
+}
+
+// is current given square attacked by the current given sides
+static inline int is_square_attacked(position *pos, int square, int side) {
+
+#ifdef ATTACK_BOARDS
+    // look up attack boards (kept for current board occupancy)
+    return (pos->attacks_to[square] & get_occupancy(pos, side)) ? 1 : 0;
+#else
+    // pick side specialized attack test (use current board occupancy)
+    return (side == white) ? is_square_attacked_occupancy(pos, square, white, get_occupancy(pos, both))
+                           : is_square_attacked_occupancy(pos, square, black, get_occupancy(pos, both));
+#endif
+}
+
 // print attacked squares
-void print_attacked_squares(int side) {
+void print_attacked_squares(position *pos, int side) {
 
     printf("\n");
     // loop over board ranks
@@ -1479,7 +2157,7 @@ void print_attacked_squares(int side) {
             }
             
             // check wheter current square is attacked or not
-            printf(" %d", is_square_attacked(square, side) ? 1 : 0);
+            printf(" %d", is_square_attacked(pos, square, side) ? 1 : 0);
         }
 
         // print newline every rank
@@ -1493,61 +2171,215 @@ void print_attacked_squares(int side) {
 }
 
 
+/*************************************************\
+===================================================
+                Attack Maps
+===================================================
+\*************************************************/
+
 /*
-          binary move bits                               hexidecimal constants
-    
-    0000 0000 0000 0000 0011 1111    source square       0x3f
-    0000 0000 0000 1111 1100 0000    target square       0xfc0
-    0000 0000 1111 0000 0000 0000    piece               0xf000
-    0000 1111 0000 0000 0000 0000    promoted piece      0xf0000
-    0001 0000 0000 0000 0000 0000    capture flag        0x100000
-    0010 0000 0000 0000 0000 0000    double push flag    0x200000
-    0100 0000 0000 0000 0000 0000    enpassant flag      0x400000
-    1000 0000 0000 0000 0000 0000    castling flag       0x800000
+    Kogge-Stone occluded fills: generators spread along a direction through empty squares
+    in 3 doubling steps (1, 2, 4 squares), wrapped squares are cut off by the direction's file mask
+
+    shift left:   1 east (not a file)   8 south   9 south east (not a file)   7 south west (not h file)
+    shift right:  1 west (not h file)   8 north   9 north west (not h file)   7 north east (not a file)
+*/
+
+#ifdef USE_AVX2
+
+// get attacks of all sliders at once (4 directions per register: 2 orthogonal & 2 diagonal lanes)
+static inline U64 get_sliders_attack_map(U64 rooks, U64 bishops, U64 occupancy) {
+
+    // init direction shifts & file masks (same lanes for both shift directions)
+    const __m256i shift_1 = _mm256_setr_epi64x(1, 8, 9, 7);
+    const __m256i shift_2 = _mm256_setr_epi64x(2, 16, 18, 14);
+    const __m256i shift_4 = _mm256_setr_epi64x(4, 32, 36, 28);
+    const __m256i masks_left = _mm256_setr_epi64x(not_a_file, ~0ULL, not_a_file, not_h_file);
+    const __m256i masks_right = _mm256_setr_epi64x(not_h_file, ~0ULL, not_h_file, not_a_file);
+
+    // init generators (rooks & queens on orthogonal lanes, bishops & queens on diagonal lanes)
+    const __m256i generators = _mm256_setr_epi64x(rooks, rooks, bishops, bishops);
+
+    // init empty squares
+    const __m256i empty = _mm256_set1_epi64x(~occupancy);
+
+    // fill left shifted directions
+    __m256i generator = generators;
+    __m256i propagator = _mm256_and_si256(empty, masks_left);
+    generator = _mm256_or_si256(generator, _mm256_and_si256(propagator, _mm256_sllv_epi64(generator, shift_1)));
+    propagator = _mm256_and_si256(propagator, _mm256_sllv_epi64(propagator, shift_1));
+    generator = _mm256_or_si256(generator, _mm256_and_si256(propagator, _mm256_sllv_epi64(generator, shift_2)));
+    propagator = _mm256_and_si256(propagator, _mm256_sllv_epi64(propagator, shift_2));
+    generator = _mm256_or_si256(generator, _mm256_and_si256(propagator, _mm256_sllv_epi64(generator, shift_4)));
+    __m256i attacks = _mm256_and_si256(_mm256_sllv_epi64(generator, shift_1), masks_left);
+
+    // fill right shifted directions
+    generator = generators;
+    propagator = _mm256_and_si256(empty, masks_right);
+    generator = _mm256_or_si256(generator, _mm256_and_si256(propagator, _mm256_srlv_epi64(generator, shift_1)));
+    propagator = _mm256_and_si256(propagator, _mm256_srlv_epi64(propagator, shift_1));
+    generator = _mm256_or_si256(generator, _mm256_and_si256(propagator, _mm256_srlv_epi64(generator, shift_2)));
+    propagator = _mm256_and_si256(propagator, _mm256_srlv_epi64(propagator, shift_2));
+    generator = _mm256_or_si256(generator, _mm256_and_si256(propagator, _mm256_srlv_epi64(generator, shift_4)));
+    attacks = _mm256_or_si256(attacks, _mm256_and_si256(_mm256_srlv_epi64(generator, shift_1), masks_right));
+
+    // merge 4 lanes into one bitboard
+    __m128i merged = _mm_or_si128(_mm256_castsi256_si128(attacks), _mm256_extracti128_si256(attacks, 1));
+    return (U64)_mm_cvtsi128_si64(merged) | (U64)_mm_extract_epi64(merged, 1);
+}
+
+#else
+
+// get attacks of generators along one direction (positive shift: left, negative shift: right)
+static inline U64 get_fill_attacks(U64 generator, U64 empty, int shift, U64 mask) {
+
+    // init propagator (empty squares generators can spread through)
+    U64 propagator = empty & mask;
+
+    // left shifted directions
+    if (shift > 0)
+    {
+        generator |= propagator & (generator << shift);
+        propagator &= propagator << shift;
+        generator |= propagator & (generator << (shift * 2));
+        propagator &= propagator << (shift * 2);
+        generator |= propagator & (generator << (shift * 4));
+        return (generator << shift) & mask;
+    }
+
+    // right shifted directions
+    shift = -shift;
+    generator |= propagator & (generator >> shift);
+    propagator &= propagator >> shift;
+    generator |= propagator & (generator >> (shift * 2));
+    propagator &= propagator >> (shift * 2);
+    generator |= propagator & (generator >> (shift * 4));
+    return (generator >> shift) & mask;
+}
+
+// get attacks of all sliders at once (one direction at a time)
+static inline U64 get_sliders_attack_map(U64 rooks, U64 bishops, U64 occupancy) {
+
+    // init empty squares
+    U64 empty = ~occupancy;
+
+    // return orthogonal & diagonal attacks
+    return get_fill_attacks(rooks, empty, 1, not_a_file) | get_fill_attacks(rooks, empty, 8, ~0ULL) |
+           get_fill_attacks(rooks, empty, -1, not_h_file) | get_fill_attacks(rooks, empty, -8, ~0ULL) |
+           get_fill_attacks(bishops, empty, 9, not_a_file) | get_fill_attacks(bishops, empty, 7, not_h_file) |
+           get_fill_attacks(bishops, empty, -9, not_h_file) | get_fill_attacks(bishops, empty, -7, not_a_file);
+}
+
+#endif
+
+// test king safety against one attack map instead of per-square lookups (pays off with the AVX2 kernel)
+#if defined(USE_AVX2) && !defined(ATTACK_BOARDS)
+    #define USE_ATTACK_MAP
+#endif
+
+// get all squares attacked by the given side (sliders see through squares missing from occupancy)
+force_inline U64 get_attack_map(position *pos, const int side, U64 occupancy) {
+
+    // init pieces of the given side
+    U64 pawns = get_bitboard(pos, (side == white) ? P : p);
+    U64 knights = get_bitboard(pos, (side == white) ? N : n);
+    U64 queens = get_bitboard(pos, (side == white) ? Q : q);
+
+    // pawn attacks
+    U64 attacks = (side == white) ? (((pawns >> 7) & not_a_file) | ((pawns >> 9) & not_h_file))
+                                  : (((pawns << 7) & not_h_file) | ((pawns << 9) & not_a_file));
+
+    // knight attacks
+    attacks |= ((knights >> 17) & not_h_file) | ((knights >> 15) & not_a_file) |
+               ((knights >> 10) & not_gh_file) | ((knights >> 6) & not_ab_file) |
+               ((knights << 17) & not_a_file) | ((knights << 15) & not_h_file) |
+               ((knights << 10) & not_ab_file) | ((knights << 6) & not_gh_file);
+
+    // king attacks
+    attacks |= king_attacks[get_ls1b_index(get_bitboard(pos, (side == white) ? K : k))];
+
+    // slider attacks
+    attacks |= get_sliders_attack_map(get_bitboard(pos, (side == white) ? R : r) | queens,
+                                      get_bitboard(pos, (side == white) ? B : b) | queens, occupancy);
+
+    // return attack map
+    return attacks;
+}
+
+/*
+          binary move bits                 hexidecimal constants
+
+    0000 0000 0011 1111    source square       0x3f
+    0000 1111 1100 0000    target square       0xfc0
+    1111 0000 0000 0000    move flags          0xf000
+
+          move flags (moving & captured pieces are looked up in the mailbox)
+
+    0000  quiet move            0100  capture                1000-1011  promotion to N, B, R, Q
+    0001  double pawn push      0101  enpassant capture      1100-1111  capture promotion to N, B, R, Q
+    0010  king side castling
+    0011  queen side castling
 */
 
+// move flags (bit 2 capture, bit 3 promotion, bits 0-1 promoted piece)
+enum {
+    quiet_flag, double_push_flag, king_castle_flag, queen_castle_flag, capture_flag, enpassant_flag,
+    knight_promotion_flag = 8, bishop_promotion_flag, rook_promotion_flag, queen_promotion_flag
+};
+
 /* This step is called a preprocessor and macros, in which the compiler will check for this before compiling resulting in less to no memory uses.
     The way it works is basically a copy and paste without the need to identify the type as in function. Personal note is like LET/LAMBDA or formulas.*/
 
-// encode move {this is called preprocessor and macros that the compiler will use before compiling if available}
-#define encode_move(source, target, piece, promoted, capture, double, enpassant, castling) \
-    (source) |           \
-    (target << 6) |      \
-    (piece << 12) |      \
-    (promoted << 16) |   \
-    (capture << 20) |    \
-    (double << 21) |     \
-    (enpassant << 22) |  \
-    (castling << 23)     \
+// encode 16-bit move {this is called preprocessor and macros that the compiler will use before compiling if available}
+#define encode_move(source, target, flags) \
+    ((source) |            \
+    ((target) << 6) |      \
+    ((flags) << 12))       \
 
 // extract source square
-#define get_move_source(move) (move & 0x3f)
+#define get_move_source(move) ((move) & 0x3f)
 
 // extract target square
-#define get_move_target(move) ((move & 0xfc0) >> 6)
+#define get_move_target(move) (((move) & 0xfc0) >> 6)
 
-// extract piece
-#define get_move_piece(move) ((move & 0xf000) >> 12)
+// extract move flags
+#define get_move_flags(move) (((move) & 0xf000) >> 12)
 
-// extract promoted piece
-#define get_move_promoted(move) ((move & 0xf0000) >> 16)
+// extract capture flag (enpassant & capture promotions included)
+#define get_move_capture(move) ((move) & 0x4000)
 
-// extract capture flag
-#define get_move_capture(move) (move & 0x100000)
+// extract promotion flag
+#define get_move_promotion(move) ((move) & 0x8000)
 
 // extract double pawn push flag
-#define get_move_double(move) (move & 0x200000)
+#define get_move_double(move) (get_move_flags(move) == double_push_flag)
 
 // extract enpassant flag
-#define get_move_enpassant(move) (move & 0x400000)
+#define get_move_enpassant(move) (get_move_flags(move) == enpassant_flag)
+
+// extract castling flag (king or queen side)
+#define get_move_castling(move) ((get_move_flags(move) & 0xe) == king_castle_flag)
+
+// extract promoted piece of the side making the move (0 if no promotion)
+#define get_move_promoted(move, side) \
+    (get_move_promotion(move) ? N + (get_move_flags(move) & 3) + ((side) == white ? 0 : 6) : 0)
+
+// extract promoted piece character (UCI notation)
+#define get_move_promoted_char(move) ("nbrq"[get_move_flags(move) & 3])
 
-// extract castling flag
-#define get_move_castling(move) (move & 0x800000)
+// move list entry (move & its ordering score packed side by side)
+typedef struct {
+    // 16-bit move
+    unsigned short move;
+
+    // move ordering score
+    short score;
+} move_entry;
 
 // move list structure
 typedef struct {
     // moves
-    int moves[256];
+    move_entry moves[256];
     
     // move count
     int count;
@@ -1556,21 +2388,42 @@ typedef struct {
 // add move to the move list
 static inline void add_move(moves *move_list, int move)
 {
-    // strore move
-    move_list->moves[move_list->count] = move;
+    // strore move (unscored)
+    move_list->moves[move_list->count].move = move;
+    move_list->moves[move_list->count].score = 0;
     
     // increment move count
     move_list->count++;
 }
 
+// pick best scored move among moves left from given index on & swap it there (one selection sort step)
+static inline int pick_move(moves *move_list, int index)
+{
+    // init best scored move
+    int best = index;
+
+    // loop over moves left
+    for (int move_count = index + 1; move_count < move_list->count; move_count++)
+        if (move_list->moves[move_count].score > move_list->moves[best].score)
+            best = move_count;
+
+    // swap best scored move to given index
+    move_entry entry = move_list->moves[index];
+    move_list->moves[index] = move_list->moves[best];
+    move_list->moves[best] = entry;
+
+    // return picked move
+    return move_list->moves[index].move;
+}
+
 // print move (for UCI purposes)
 void print_move(int move)
 {
-    if (get_move_promoted(move))
+    if (get_move_promotion(move))
     {
         printf("%s%s%c\n", square_to_coordinates[get_move_source(move)],
                      square_to_coordinates[get_move_target(move)],
-                     promoted_pieces[get_move_promoted(move)]);
+                     get_move_promoted_char(move));
     }
     else
     {
@@ -1579,8 +2432,8 @@ void print_move(int move)
     }
 }
 
-// print move list
-void print_move_list(moves *move_list)
+// print move list (moving pieces are looked up in the position's mailbox)
+void print_move_list(position *pos, moves *move_list)
 {
     // do nothing on empty move list
     if (!move_list->count)
@@ -1596,14 +2449,14 @@ void print_move_list(moves *move_list)
     for (int move_count = 0; move_count < move_list->count; move_count++)
     {
         // init move
-        int move = move_list->moves[move_count];
+        int move = move_list->moves[move_count].move;
         
         #ifdef WIN64
             // print move
             printf("     %s%s%c   %c       %d         %d         %d         %d\n", square_to_coordinates[get_move_source(move)],
                                                                                   square_to_coordinates[get_move_target(move)],
-                                                                                  get_move_promoted(move) ? promoted_pieces[get_move_promoted(move)] : ' ',
-                                                                                  ascii_pieces[get_move_piece(move)],
+                                                                                  get_move_promotion(move) ? get_move_promoted_char(move) : ' ',
+                                                                                  ascii_pieces[pos->mailbox[get_move_source(move)]],
                                                                                   get_move_capture(move) ? 1 : 0,
                                                                                   get_move_double(move) ? 1 : 0,
                                                                                   get_move_enpassant(move) ? 1 : 0,
@@ -1612,8 +2465,8 @@ void print_move_list(moves *move_list)
             // print move
             printf("     %s%s%c   %s       %d         %d         %d         %d\n", square_to_coordinates[get_move_source(move)],
                                                                                   square_to_coordinates[get_move_target(move)],
-                                                                                  get_move_promoted(move) ? promoted_pieces[get_move_promoted(move)] : ' ',
-                                                                                  unicode_pieces[get_move_piece(move)],
+                                                                                  get_move_promotion(move) ? get_move_promoted_char(move) : ' ',
+                                                                                  unicode_pieces[pos->mailbox[get_move_source(move)]],
                                                                                   get_move_capture(move) ? 1 : 0,
                                                                                   get_move_double(move) ? 1 : 0,
                                                                                   get_move_enpassant(move) ? 1 : 0,
@@ -1625,22 +2478,171 @@ void print_move_list(moves *move_list)
         printf("\n\n     Total number of moves: %d\n\n", move_list->count);
 }
 
-// preserve board state
-#define copy_board()                                                      \
-    U64 bitboards_copy[12], occupancies_copy[3];                          \
-    int side_copy, enpassant_copy, castle_copy;                           \
-    memcpy(bitboards_copy, bitboards, 96);                                \
-    memcpy(occupancies_copy, occupancies, 24);                            \
-    side_copy = side, enpassant_copy = enpassant, castle_copy = castle;   \
+/*************************************************\
+===================================================
+                Attack Boards
+===================================================
+\*************************************************/
 
-// restore board state
-#define take_back()                                                       \
-    memcpy(bitboards, bitboards_copy, 96);                                \
-    memcpy(occupancies, occupancies_copy, 24);                            \
-    side = side_copy, enpassant = enpassant_copy, castle = castle_copy;   \
+#ifdef ATTACK_BOARDS
 
-// move types 0 , 1
-enum { all_moves, only_captures };
+// get attacks of given piece standing on given square
+static inline U64 get_piece_attacks(int piece, int square, U64 occupancy) {
+
+    // pick up piece attacks
+    switch (piece)
+    {
+        case P: return pawn_attacks[white][square];
+        case p: return pawn_attacks[black][square];
+        case N: case n: return knight_attacks[square];
+        case B: case b: return get_bishop_attacks(square, occupancy);
+        case R: case r: return get_rook_attacks(square, occupancy);
+        case Q: case q: return get_queen_attacks(square, occupancy);
+        case K: case k: return king_attacks[square];
+        default: return 0ULL;
+    }
+}
+
+// set attacks from square & flip square within attack-to boards of squares it gained or lost
+static inline void set_attacks_from(position *pos, int square, U64 attacks) {
+
+    // init squares gained or lost
+    U64 changed = pos->attacks_from[square] ^ attacks;
+
+    // update attacks from square
+    pos->attacks_from[square] = attacks;
+
+    // loop over squares gained or lost
+    while (changed)
+    {
+        // flip square within attack-to board
+        pos->attacks_to[get_ls1b_index(changed)] ^= 1ULL << square;
+
+        // pop ls1b of changed squares
+        pop_ls1b(changed);
+    }
+}
+
+// init attack boards from scratch
+void init_attack_boards(position *pos) {
+
+    // reset attack boards
+    memset(pos->attacks_from, 0ULL, sizeof(pos->attacks_from));
+    memset(pos->attacks_to, 0ULL, sizeof(pos->attacks_to));
+
+    // loop over occupied squares
+    for (int square = 0; square < 64; square++)
+        if (pos->mailbox[square] != no_piece)
+            set_attacks_from(pos, square, get_piece_attacks(pos->mailbox[square], square, get_occupancy(pos, both)));
+}
+
+// update attack boards once pieces appeared on or left changed squares (same update for make & unmake)
+static inline void update_attack_boards(position *pos, U64 changed) {
+
+    // init sliders of both sides
+    U64 sliders = get_bitboard(pos, B) | get_bitboard(pos, b) | get_bitboard(pos, R) |
+                  get_bitboard(pos, r) | get_bitboard(pos, Q) | get_bitboard(pos, q);
+
+    // pieces to refresh: pieces on changed squares & sliders whose rays reach them
+    U64 refresh = changed;
+
+    // loop over changed squares
+    while (changed)
+    {
+        // add sliders attacking changed square
+        refresh |= pos->attacks_to[get_ls1b_index(changed)] & sliders;
+
+        // pop ls1b of changed squares
+        pop_ls1b(changed);
+    }
+
+    // loop over pieces to refresh (empty squares get no attacks)
+    while (refresh)
+    {
+        // init square
+        int square = get_ls1b_index(refresh);
+
+        // refresh attacks from square
+        set_attacks_from(pos, square, get_piece_attacks(pos->mailbox[square], square, get_occupancy(pos, both)));
+
+        // pop ls1b of pieces to refresh
+        pop_ls1b(refresh);
+    }
+}
+
+// get squares move puts pieces on or takes them from (side is the side making the move)
+force_inline U64 get_move_changed_squares(int move, const int side) {
+
+    // init source & target squares
+    int target_square = get_move_target(move);
+    U64 changed = (1ULL << get_move_source(move)) | (1ULL << target_square);
+
+    // enpassant captured pawn is standing behind the target square
+    if (get_move_enpassant(move))
+        changed |= 1ULL << ((side == white) ? target_square + 8 : target_square - 8);
+
+    // castling rook squares
+    if (get_move_castling(move))
+    {
+        switch (target_square)
+        {
+            case (g1): changed |= (1ULL << h1) | (1ULL << f1); break;
+            case (c1): changed |= (1ULL << a1) | (1ULL << d1); break;
+            case (g8): changed |= (1ULL << h8) | (1ULL << f8); break;
+            default: changed |= (1ULL << a8) | (1ULL << d8); break;
+        }
+    }
+
+    // return changed squares
+    return changed;
+}
+
+#endif
+
+// is square the king steps to attacked by given side (king itself doesn't block sliders' rays behind it)
+force_inline int is_king_step_attacked(position *pos, int square, int king_square, const int side) {
+
+#ifdef ATTACK_BOARDS
+    // attacked on current board
+    if (pos->attacks_to[square] & get_occupancy(pos, side)) return 1;
+
+    // init sliders giving check
+    U64 sliders = pos->attacks_to[king_square] & ((side == white) ?
+                  (get_bitboard(pos, B) | get_bitboard(pos, R) | get_bitboard(pos, Q)) :
+                  (get_bitboard(pos, b) | get_bitboard(pos, r) | get_bitboard(pos, q)));
+
+    // loop over checking sliders
+    while (sliders)
+    {
+        // init slider square
+        int slider_square = get_ls1b_index(sliders);
+
+        // square on the checking ray behind the king (capturing the slider itself is fine)
+        if (square != slider_square && get_bit(line_masks[king_square][slider_square], square)) return 1;
+
+        // pop ls1b of checking sliders
+        pop_ls1b(sliders);
+    }
+
+    // square is safe
+    return 0;
+#else
+    // test square with the king taken off the board
+    return is_square_attacked_occupancy(pos, square, side, get_occupancy(pos, both) ^ (1ULL << king_square));
+#endif
+}
+
+// preserve board state
+#define copy_board(pos)                                                   \
+    position board_copy;                                                  \
+    memcpy(&board_copy, (pos), sizeof(position));                         \
+
+// restore board state
+#define take_back(pos)                                                    \
+    memcpy((pos), &board_copy, sizeof(position));                         \
+
+// move types 0 , 1
+enum { all_moves, only_captures };
 
 /*
                            castling   move     in      in
@@ -1670,89 +2672,249 @@ const int castling_rights[64] = {
     13, 15, 15, 15, 12, 15, 15, 14
 };
 
-// make move on chess board
-static inline int make_move(int move, int move_flag) {
+#ifdef MAKE_UNMAKE
+
+// take move back on chess board (reverse of make_move using the undo stack, side is the side that made the move)
+force_inline void unmake_move_side(position *pos, int move, const int side) {
+
+    // pop undo record
+    undo *state = &pos->undo_stack[--pos->ply];
+
+    // restore side that made the move
+    pos->side ^= 1;
+
+    // parse move (moved piece is standing on target square, promoted pieces turn back into pawns)
+    int source_square = get_move_source(move);
+    int target_square = get_move_target(move);
+    int promoted_piece = get_move_promoted(move, side);
+    int piece = promoted_piece ? ((side == white) ? P : p) : pos->mailbox[target_square];
+
+    // turn promoted piece back into a pawn
+    if (promoted_piece)
+    {
+        pop_piece(pos, promoted_piece, target_square);
+        set_piece(pos, piece, target_square);
+    }
+
+    // move piece back
+    pop_piece(pos, piece, target_square);
+    set_piece(pos, piece, source_square);
+
+    // update mailbox
+    pos->mailbox[target_square] = no_piece;
+    pos->mailbox[source_square] = piece;
+
+    // init source & target squares mask
+    U64 from_to = (1ULL << source_square) | (1ULL << target_square);
+
+    // update occupancies (set source square and clear target square)
+    toggle_occupancy(pos, side, from_to);
+
+    // put captured piece back
+    if (state->captured != no_piece)
+    {
+        // init captured square (enpassant captured pawn is standing behind the target square)
+        int captured_square = target_square;
+        if (get_move_enpassant(move)) captured_square = (side == white) ? target_square + 8 : target_square - 8;
+
+        // restore captured piece on bitboard & mailbox
+        set_piece(pos, state->captured, captured_square);
+        pos->mailbox[captured_square] = state->captured;
+
+        // restore captured piece occupancies
+        toggle_occupancy(pos, side ^ 1, (1ULL << captured_square));
+    }
+
+    // move castling rook back
+    if (get_move_castling(move))
+    {
+        // rook's squares & piece
+        int rook_from, rook_to, rook;
+
+        // switch rook depending on castling side
+        switch (target_square)
+        {
+            // white castles king side
+        case (g1): rook = R; rook_from = h1; rook_to = f1; break;
+
+            // white castles queen side
+        case (c1): rook = R; rook_from = a1; rook_to = d1; break;
+
+            // black castles king side
+        case (g8): rook = r; rook_from = h8; rook_to = f8; break;
+
+            // black castles queen side
+        default: rook = r; rook_from = a8; rook_to = d8; break;
+        }
+
+        // move rook back on bitboard & mailbox
+        pop_piece(pos, rook, rook_to);
+        set_piece(pos, rook, rook_from);
+        pos->mailbox[rook_to] = no_piece;
+        pos->mailbox[rook_from] = rook;
+
+        // update occupancies
+        toggle_occupancy(pos, side, (1ULL << rook_from) | (1ULL << rook_to));
+    }
+
+#ifdef ATTACK_BOARDS
+    // update attack boards
+    update_attack_boards(pos, get_move_changed_squares(move, side));
+#endif
+
+    // restore irreversible state
+    pos->castle = state->castle;
+    pos->enpassant = state->enpassant;
+    pos->hash_key = state->hash_key;
+
+    #ifdef DEBUG
+        // make sure pieces were put back where the restored hash key expects them
+        if (pos->hash_key != generate_hash_key(pos))
+        {
+            printf("\n\n     Unmake move: ");
+            print_move(move);
+            print_board(pos);
+        }
+
+        #ifdef ATTACK_BOARDS
+            // make sure attack boards were put back too (local copy, perft threads run this concurrently)
+            position board_check[1];
+            memcpy(board_check, pos, sizeof(position));
+            init_attack_boards(board_check);
+            if (memcmp(board_check->attacks_to, pos->attacks_to, sizeof(pos->attacks_to)))
+                printf("     unmake attack boards mismatch\n");
+        #endif
+    #endif
+}
+
+// take move back on chess board (pick side specialized body, side to move is the opponent of the side that made the move)
+static inline void unmake_move(position *pos, int move) {
+
+    // white made the move
+    if (pos->side == black)
+        unmake_move_side(pos, move, white);
+
+    // black made the move
+    else
+        unmake_move_side(pos, move, black);
+}
+
+#endif
+
+// make move on chess board (side specialized body, side is the side to move)
+force_inline int make_move_side(position *pos, int move, int move_flag, const int side) {
 
     // quiet moves
     if (move_flag == all_moves)
     {
-        // preserve board states *if the moves is illegal then the macro will goes back to the previous state
-        copy_board();
-
         // parse move
         int source_square = get_move_source(move);
         int target_square = get_move_target(move);
-        int piece = get_move_piece(move);
-        int promoted_piece = get_move_promoted(move);
+        int promoted_piece = get_move_promoted(move, side);
         int capture = get_move_capture(move);
         int double_push = get_move_double(move);
         int enpass = get_move_enpassant(move);
         int castling = get_move_castling(move);
 
-        // move piece
-        pop_bit(bitboards[piece], source_square);
-        set_bit(bitboards[piece], target_square);
+        // init moving & captured pieces from mailbox (enpassant captures enemy pawn)
+        int piece = pos->mailbox[source_square];
+        int captured_piece = enpass ? ((side == white) ? p : P) : pos->mailbox[target_square];
+
+#ifdef MAKE_UNMAKE
+    #ifdef DEBUG
+        // make sure undo stack has room for one more record
+        if (pos->ply >= max_ply)
+        {
+            printf("\n\n     Undo stack overflow: more than %d plies made since parse_fen\n", max_ply);
+            exit(1);
+        }
+    #endif
+
+        // push undo record (unmake_move will pop it and restore the previous state)
+        undo *state = &pos->undo_stack[pos->ply++];
+        state->hash_key = pos->hash_key;
+        state->captured = capture ? captured_piece : no_piece;
+        state->castle = pos->castle;
+        state->enpassant = pos->enpassant;
+#endif
 
         // handling captures moves if true moves is capturing something
         if (capture)
         {
-            // pickup bitboard piece index ranges depending on side
-            int start_piece, end_piece;
+            // init captured square
+            int captured_square = target_square;
 
-            // white to move
-            if (side == white)
+            // enpassant captured pawn is standing behind the target square
+            if (enpass)
             {
-                start_piece = p;
-                end_piece = k;
-            }
+                // shift captured square depending on side to move
+                captured_square = (side == white) ? target_square + 8 : target_square - 8;
 
-            // black to move
-            else
-            {
-                start_piece = P;
-                end_piece = K;
-            }
-            
-            // loop over bitboards opposite to the current side to move
-            for (int bb_piece = start_piece; bb_piece <= end_piece; bb_piece++)
-            {
-                // if there is a piece on the capturing target square
-                if (get_bit(bitboards[bb_piece], target_square))
-                {
-                    // remove it from the corresponding bitboards
-                    pop_bit(bitboards[bb_piece], target_square);
-                    break;
-                }
-                
+                // clear captured pawn from mailbox (target square is overwritten by the moving piece)
+                pos->mailbox[captured_square] = no_piece;
             }
-            
+
+            // remove captured piece from the corresponding bitboard
+            pop_piece(pos, captured_piece, captured_square);
+
+            // remove the piece from hash key
+            pos->hash_key ^= piece_keys[captured_piece][captured_square];
+
+            // remove captured piece from occupancies (moving piece lands on target square below)
+            toggle_occupancy(pos, side ^ 1, (1ULL << captured_square));
         }
 
+        // move piece
+        pop_piece(pos, piece, source_square);
+        set_piece(pos, piece, target_square);
+
+        // hash piece (remove piece from source square and place it on target square)
+        pos->hash_key ^= piece_keys[piece][source_square];
+        pos->hash_key ^= piece_keys[piece][target_square];
+
+        // update mailbox (piece leaves source square and lands on target square)
+        pos->mailbox[source_square] = no_piece;
+        pos->mailbox[target_square] = piece;
+
+        // init source & target squares mask
+        U64 from_to = (1ULL << source_square) | (1ULL << target_square);
+
+        // update occupancies (clear source square and set target square)
+        toggle_occupancy(pos, side, from_to);
+
         // handle pawn promotions
         if (promoted_piece)
         {
             // erase the pawn from the target square
-            pop_bit(bitboards[(side == white) ? P : p], target_square);
+            pop_piece(pos, (side == white) ? P : p, target_square);
+
+            // remove pawn from hash key
+            pos->hash_key ^= piece_keys[(side == white) ? P : p][target_square];
 
             // set up promoted piece on chess board on target square
-            set_bit(bitboards[promoted_piece], target_square);
-        }
-        
-        // handle enpassant captures
-        if (enpass)
-        {
-            // erase the pawn depending on side to move
-            (side == white) ? pop_bit(bitboards[p], target_square + 8) : pop_bit(bitboards[P], target_square - 8);
+            set_piece(pos, promoted_piece, target_square);
+
+            // add promoted piece into the hash key
+            pos->hash_key ^= piece_keys[promoted_piece][target_square];
+
+            // update mailbox
+            pos->mailbox[target_square] = promoted_piece;
         }
         
+        // hash enpassant if available (remove enpassant square from hash key)
+        if (pos->enpassant != no_sq) pos->hash_key ^= enpassant_keys[pos->enpassant];
+
         // reset enpassant square
-        enpassant = no_sq;
+        pos->enpassant = no_sq;
 
         // handle double pawn push
         if (double_push)
         {
             // set enpassant square depending on side to move
-            (side == white) ? (enpassant = target_square + 8) : (enpassant = target_square - 8);
+            (side == white) ? (pos->enpassant = target_square + 8) : (pos->enpassant = target_square - 8);
+
+            // hash enpassant
+            pos->hash_key ^= enpassant_keys[pos->enpassant];
         }
         
         // handle castling moves
@@ -1763,77 +2925,155 @@ static inline int make_move(int move, int move_flag) {
             {
                 // white castles king side
             case (g1):
-                pop_bit(bitboards[R], h1);
-                set_bit(bitboards[R], f1);
+                pop_piece(pos, R, h1);
+                set_piece(pos, R, f1);
+
+                // hash rook
+                pos->hash_key ^= piece_keys[R][h1];
+                pos->hash_key ^= piece_keys[R][f1];
+
+                // update mailbox
+                pos->mailbox[h1] = no_piece;
+                pos->mailbox[f1] = R;
+
+                // update occupancies
+                toggle_occupancy(pos, white, (1ULL << h1) | (1ULL << f1));
                 break;
 
                   // white castles queen side
             case (c1):
-                pop_bit(bitboards[R], a1);
-                set_bit(bitboards[R], d1);
+                pop_piece(pos, R, a1);
+                set_piece(pos, R, d1);
+
+                // hash rook
+                pos->hash_key ^= piece_keys[R][a1];
+                pos->hash_key ^= piece_keys[R][d1];
+
+                // update mailbox
+                pos->mailbox[a1] = no_piece;
+                pos->mailbox[d1] = R;
+
+                // update occupancies
+                toggle_occupancy(pos, white, (1ULL << a1) | (1ULL << d1));
                 break;
 
                   // black castles king side
             case (g8):
-                pop_bit(bitboards[r], h8);
-                set_bit(bitboards[r], f8);
+                pop_piece(pos, r, h8);
+                set_piece(pos, r, f8);
+
+                // hash rook
+                pos->hash_key ^= piece_keys[r][h8];
+                pos->hash_key ^= piece_keys[r][f8];
+
+                // update mailbox
+                pos->mailbox[h8] = no_piece;
+                pos->mailbox[f8] = r;
+
+                // update occupancies
+                toggle_occupancy(pos, black, (1ULL << h8) | (1ULL << f8));
                 break;
 
                   // black castles queen side
             case (c8):
-                pop_bit(bitboards[r], a8);
-                set_bit(bitboards[r], d8);
+                pop_piece(pos, r, a8);
+                set_piece(pos, r, d8);
+
+                // hash rook
+                pos->hash_key ^= piece_keys[r][a8];
+                pos->hash_key ^= piece_keys[r][d8];
+
+                // update mailbox
+                pos->mailbox[a8] = no_piece;
+                pos->mailbox[d8] = r;
+
+                // update occupancies
+                toggle_occupancy(pos, black, (1ULL << a8) | (1ULL << d8));
                 break;
             
             default:
                 break;
             }
         }
+
+#ifdef ATTACK_BOARDS
+        // update attack boards
+        update_attack_boards(pos, get_move_changed_squares(move, side));
+#endif
         
-        // update castling rights
-        castle &= castling_rights[source_square];
-        castle &= castling_rights[target_square];
+        // hash castling (remove old castling rights from hash key)
+        pos->hash_key ^= castle_keys[pos->castle];
 
-        // reset occupancies
-        memset(occupancies, 0ULL, 24);
+        // update castling rights
+        pos->castle &= castling_rights[source_square];
+        pos->castle &= castling_rights[target_square];
 
-        // loop over white pieces bitboards
-        for (int bb_piece = P; bb_piece <= K; bb_piece++)
-        {
-            // update white occupancies
-            occupancies[white] |= bitboards[bb_piece];
-        }
-        
-        // loop over black pieces bitboards
-        for (int bb_piece = p; bb_piece <= k; bb_piece++)
-        {
-            // update white occupancies
-            occupancies[black] |= bitboards[bb_piece];
-        }
-        
-        // update both sides occupancies
-        occupancies[both] |= occupancies[white];
-        occupancies[both] |= occupancies[black];
+        // hash castling (add updated castling rights to hash key)
+        pos->hash_key ^= castle_keys[pos->castle];
 
         // change side
-        side ^= 1;
-        
-        // makesure that king has not been exposed into a check
-        if (is_square_attacked((side == white) ? get_ls1b_index(bitboards[k]) : get_ls1b_index(bitboards[K]) , side))
-        {
-            // move is illegal since the king will be in check and take it back
-            take_back();
+        pos->side ^= 1;
 
-            // return illegal move
-            return 0;
-        }
-        
-        else
-        {
-            // return legal moves
-            return 1;
-        }
+        // hash side
+        pos->hash_key ^= side_key;
+
+        #ifdef DEBUG
+            // make sure incrementally updated hash key matches the one built from scratch
+            if (pos->hash_key != generate_hash_key(pos))
+            {
+                printf("\n\n     Make move: ");
+                print_move(move);
+                print_board(pos);
+                printf("     hash key should be: %llx\n", generate_hash_key(pos));
+            }
+
+            // make sure occupancies are in sync with piece bitboards
+            U64 white_occupancy = 0ULL, black_occupancy = 0ULL;
+            for (int bb_piece = P; bb_piece <= K; bb_piece++) white_occupancy |= get_bitboard(pos, bb_piece);
+            for (int bb_piece = p; bb_piece <= k; bb_piece++) black_occupancy |= get_bitboard(pos, bb_piece);
+            if (get_occupancy(pos, white) != white_occupancy ||
+                get_occupancy(pos, black) != black_occupancy ||
+                get_occupancy(pos, both) != (white_occupancy | black_occupancy))
+                printf("     occupancies mismatch\n");
+
+            // make sure mailbox is in sync with piece bitboards
+            for (int square = 0; square < 64; square++)
+            {
+                // piece found on square within piece bitboards
+                int bb_piece_found = no_piece;
+
+                // loop over all pieces bitboards
+                for (int bb_piece = P; bb_piece <= k; bb_piece++)
+                    if (get_bit(get_bitboard(pos, bb_piece), square)) bb_piece_found = bb_piece;
+
+                // report mismatch
+                if (pos->mailbox[square] != bb_piece_found)
+                    printf("     mailbox mismatch on %s\n", square_to_coordinates[square]);
+            }
+
+            #ifdef ATTACK_BOARDS
+                // make sure incrementally updated attack boards match the ones built from scratch (local copy, thread safe)
+                position board_check[1];
+                memcpy(board_check, pos, sizeof(position));
+                init_attack_boards(board_check);
+                if (memcmp(board_check->attacks_from, pos->attacks_from, sizeof(pos->attacks_from)) ||
+                    memcmp(board_check->attacks_to, pos->attacks_to, sizeof(pos->attacks_to)))
+                    printf("     attack boards mismatch\n");
+            #endif
+        #endif
         
+        #ifdef DEBUG
+            // move generator is legal so king can't be left in check
+            if (is_square_attacked(pos, (pos->side == white) ? get_ls1b_index(get_bitboard(pos, k)) : get_ls1b_index(get_bitboard(pos, K)) , pos->side))
+            {
+                printf("\n\n     Illegal move generated: ");
+                print_move(move);
+                print_board(pos);
+            }
+        #endif
+
+        // return legal move
+        return 1;
     }
     
     // captures moves
@@ -1842,7 +3082,7 @@ static inline int make_move(int move, int move_flag) {
         // make sure move is the capture
         if (get_move_capture(move))
         {
-            make_move(move, all_moves);
+            return make_move_side(pos, move, all_moves, side);
         }
 
         // otherwise the move is not a capture
@@ -1857,8 +3097,130 @@ static inline int make_move(int move, int move_flag) {
     
 }
 
-// generate all moves skeleton
-static inline void generate_moves(moves *move_list) {
+// make move on chess board (pick side specialized body once per move)
+static inline int make_move(position *pos, int move, int move_flag) {
+
+    // white to move
+    if (pos->side == white)
+        return make_move_side(pos, move, move_flag, white);
+
+    // black to move
+    else
+        return make_move_side(pos, move, move_flag, black);
+}
+
+// is enpassant capture legal (it removes two pawns from the same rank so verify king safety directly)
+force_inline int is_enpassant_legal(position *pos, int source_square, int king_square, const int side) {
+
+    // init captured pawn square (standing behind enpassant square)
+    int captured_square = (side == white) ? pos->enpassant + 8 : pos->enpassant - 8;
+
+    // init occupancy after capture (capturing & captured pawns leave, capturing pawn lands on enpassant square)
+    U64 occupancy = (get_occupancy(pos, both) ^ (1ULL << source_square) ^ (1ULL << captured_square)) | (1ULL << pos->enpassant);
+
+    // white to move
+    if (side == white)
+    {
+        // sliders see through the vacated squares
+        if (get_bishop_attacks(king_square, occupancy) & (get_bitboard(pos, b) | get_bitboard(pos, q))) return 0;
+        if (get_rook_attacks(king_square, occupancy) & (get_bitboard(pos, r) | get_bitboard(pos, q))) return 0;
+
+        // other checkers (except the captured pawn) remain
+        if (knight_attacks[king_square] & get_bitboard(pos, n)) return 0;
+        if (pawn_attacks[white][king_square] & get_bitboard(pos, p) & ~(1ULL << captured_square)) return 0;
+    }
+
+    // black to move
+    else
+    {
+        // sliders see through the vacated squares
+        if (get_bishop_attacks(king_square, occupancy) & (get_bitboard(pos, B) | get_bitboard(pos, Q))) return 0;
+        if (get_rook_attacks(king_square, occupancy) & (get_bitboard(pos, R) | get_bitboard(pos, Q))) return 0;
+
+        // other checkers (except the captured pawn) remain
+        if (knight_attacks[king_square] & get_bitboard(pos, N)) return 0;
+        if (pawn_attacks[black][king_square] & get_bitboard(pos, P) & ~(1ULL << captured_square)) return 0;
+    }
+
+    // enpassant capture is legal
+    return 1;
+}
+
+// move generation stages
+enum { gen_all, gen_captures, gen_quiets, gen_evasions };
+
+// check & pin information of the side to move (computed once per node)
+typedef struct {
+    // king square of the side to move
+    int king_square;
+
+    // pieces giving check to the king
+    U64 checkers;
+
+    // squares non king moves must land on (any square, block/capture single checker, none on double check)
+    U64 check_mask;
+
+    // pinned pieces of the side to move
+    U64 pinned;
+} check_info;
+
+// init check & pin information of the side to move
+force_inline void init_check_info(position *pos, check_info *info, const int side) {
+
+    // init king square of the side to move
+    int king_square = get_ls1b_index(get_bitboard(pos, (side == white) ? K : k));
+    info->king_square = king_square;
+
+    // init enemy sliders bitboards
+    U64 enemy_bishops = (side == white) ? (get_bitboard(pos, b) | get_bitboard(pos, q)) : (get_bitboard(pos, B) | get_bitboard(pos, Q));
+    U64 enemy_rooks = (side == white) ? (get_bitboard(pos, r) | get_bitboard(pos, q)) : (get_bitboard(pos, R) | get_bitboard(pos, Q));
+
+    // init pieces giving check to the king of the side to move
+#ifdef ATTACK_BOARDS
+    info->checkers = pos->attacks_to[king_square] & get_occupancy(pos, side ^ 1);
+#else
+    info->checkers = attackers_to(pos, king_square, get_occupancy(pos, both)) & get_occupancy(pos, side ^ 1);
+#endif
+
+    // not in check (any square)
+    info->check_mask = ~0ULL;
+
+    // single check
+    if (info->checkers && !(info->checkers & (info->checkers - 1)))
+        // capture the checker or block its ray
+        info->check_mask = info->checkers | between_masks[king_square][get_ls1b_index(info->checkers)];
+
+    // double check (only king moves)
+    else if (info->checkers)
+        info->check_mask = 0ULL;
+
+    // init pinned pieces of the side to move
+    info->pinned = 0ULL;
+
+    // init enemy sliders lined up with the king on an empty board
+    U64 snipers = (get_bishop_attacks(king_square, 0ULL) & enemy_bishops) |
+                  (get_rook_attacks(king_square, 0ULL) & enemy_rooks);
+
+    // loop over snipers
+    while (snipers)
+    {
+        // init sniper square
+        int sniper_square = get_ls1b_index(snipers);
+
+        // init pieces standing between king and sniper
+        U64 blockers = between_masks[king_square][sniper_square] & get_occupancy(pos, both);
+
+        // single friendly blocker is pinned
+        if (blockers && !(blockers & (blockers - 1)) && (blockers & get_occupancy(pos, side)))
+            info->pinned |= blockers;
+
+        // pop ls1b of snipers
+        pop_ls1b(snipers);
+    }
+}
+
+// generate legal moves of the given stage (captures & promotions, quiets or both)
+force_inline void generate_stage_moves(position *pos, moves *move_list, check_info *info, const int stage, const int side) {
 
     // init move count
     move_list->count = 0;
@@ -1869,11 +3231,26 @@ static inline void generate_moves(moves *move_list) {
     // define current piece's bitboard copy & it's attacks
     U64 bitboard, attacks;
 
-    // loop over all the bitboards
-    for (int piece = P; piece <= k; piece++)
+    // init check & pin information
+    int king_square = info->king_square;
+    U64 checkers = info->checkers;
+    U64 check_mask = info->check_mask;
+    U64 pinned = info->pinned;
+
+    // init squares pieces may land on depending on stage (enemy pieces, empty squares or both)
+    U64 target_mask = (stage == gen_captures) ? get_occupancy(pos, side ^ 1) :
+                      (stage == gen_quiets) ? ~get_occupancy(pos, both) : ~get_occupancy(pos, side);
+
+#ifdef USE_ATTACK_MAP
+    // init squares attacked by the enemy (king itself doesn't block sliders' rays behind it)
+    U64 attacked = get_attack_map(pos, side ^ 1, get_occupancy(pos, both) ^ (1ULL << king_square));
+#endif
+
+    // loop over the bitboards of the side to move
+    for (int piece = (side == white) ? P : p; piece <= ((side == white) ? K : k); piece++)
     {
         // init piece bitboard copy
-        bitboard = bitboards[piece];
+        bitboard = get_bitboard(pos, piece);
 
         // generate white pawns and white king castling moves
         if (side == white)
@@ -1887,32 +3264,39 @@ static inline void generate_moves(moves *move_list) {
                     // init source square 
                     source_square = get_ls1b_index(bitboard);
 
+                    // init squares current pawn may land on (pinned pawns stay on the pin line)
+                    U64 legal_targets = check_mask;
+                    if (get_bit(pinned, source_square)) legal_targets &= line_masks[king_square][source_square];
+
                     // init target square
                     target_square = source_square - 8;
 
                     // generate quiet pawn moves
-                    if (!(target_square < a8) && !get_bit(occupancies[both], target_square))
+                    if (!(target_square < a8) && !get_bit(get_occupancy(pos, both), target_square))
                     {
                         // pawn promotion
                         if (source_square >= a7 && source_square <= h7)
                         {
-
-                            add_move(move_list, encode_move(source_square, target_square, piece, Q, 0, 0, 0, 0));
-                            add_move(move_list, encode_move(source_square, target_square, piece, R, 0, 0, 0, 0));
-                            add_move(move_list, encode_move(source_square, target_square, piece, B, 0, 0, 0, 0));
-                            add_move(move_list, encode_move(source_square, target_square, piece, N, 0, 0, 0, 0));
-
+                            // promotion square is legal (promotions belong to captures stage)
+                            if (stage != gen_quiets && get_bit(legal_targets, target_square))
+                            {
+                                add_move(move_list, encode_move(source_square, target_square, queen_promotion_flag));
+                                add_move(move_list, encode_move(source_square, target_square, rook_promotion_flag));
+                                add_move(move_list, encode_move(source_square, target_square, bishop_promotion_flag));
+                                add_move(move_list, encode_move(source_square, target_square, knight_promotion_flag));
+                            }
                         }
 
-                        else
+                        else if (stage != gen_captures)
                         {
                             // one square ahead pawn move
-                            add_move(move_list, encode_move(source_square, target_square, piece, 0, 0, 0, 0, 0));
+                            if (get_bit(legal_targets, target_square))
+                                add_move(move_list, encode_move(source_square, target_square, quiet_flag));
 
                             // two squares ahead pawn move
-                            if ((source_square >= a2 && source_square <= h2) && !get_bit(occupancies[both], target_square - 8))
+                            if ((source_square >= a2 && source_square <= h2) && !get_bit(get_occupancy(pos, both), target_square - 8) && get_bit(legal_targets, target_square - 8))
                             {
-                                add_move(move_list, encode_move(source_square, target_square - 8, piece, 0, 0, 1, 0, 0));
+                                add_move(move_list, encode_move(source_square, target_square - 8, double_push_flag));
 
                             }
                             
@@ -1920,8 +3304,8 @@ static inline void generate_moves(moves *move_list) {
                         
                     }
 
-                     // init pawn attacks bitboard
-                    attacks = pawn_attacks[side][source_square] & occupancies[black];
+                     // init pawn attacks bitboard (no captures in quiets stage)
+                    attacks = (stage != gen_quiets) ? pawn_attacks[side][source_square] & get_occupancy(pos, black) & legal_targets : 0ULL;
                     
                     // generate pawn captures
                     while (attacks)
@@ -1932,56 +3316,60 @@ static inline void generate_moves(moves *move_list) {
                         // pawn promotion
                         if (source_square >= a7 && source_square <= h7)
                         {
-                            add_move(move_list, encode_move(source_square, target_square, piece, Q, 1, 0, 0, 0));
-                            add_move(move_list, encode_move(source_square, target_square, piece, R, 1, 0, 0, 0));
-                            add_move(move_list, encode_move(source_square, target_square, piece, B, 1, 0, 0, 0));
-                            add_move(move_list, encode_move(source_square, target_square, piece, N, 1, 0, 0, 0));
+                            add_move(move_list, encode_move(source_square, target_square, queen_promotion_flag | capture_flag));
+                            add_move(move_list, encode_move(source_square, target_square, rook_promotion_flag | capture_flag));
+                            add_move(move_list, encode_move(source_square, target_square, bishop_promotion_flag | capture_flag));
+                            add_move(move_list, encode_move(source_square, target_square, knight_promotion_flag | capture_flag));
                         }
                         
                         else
                         {
                             // one square ahead pawn move
-                            add_move(move_list, encode_move(source_square, target_square, piece, 0, 1, 0, 0, 0));
+                            add_move(move_list, encode_move(source_square, target_square, capture_flag));
                         }
                         
                         // pop ls1b of the pawn attacks
-                        pop_bit(attacks, target_square);
+                        pop_ls1b(attacks);
                     }
                     
                     // generate enpassant captures
-                    if (enpassant != no_sq)
+                    if (stage != gen_quiets && pos->enpassant != no_sq)
                     {
                         // lookup pawn attacks and bitwise AND with enpassant square (bit)
-                        U64 enpassant_attacks = pawn_attacks[side][source_square] & (1ULL << enpassant);
+                        U64 enpassant_attacks = pawn_attacks[side][source_square] & (1ULL << pos->enpassant);
                         
-                        // make sure enpassant capture available
-                        if (enpassant_attacks)
+                        // make sure enpassant capture available and doesn't expose the king
+                        if (enpassant_attacks && is_enpassant_legal(pos, source_square, king_square, side))
                         {
                             // init enpassant capture target square
                             int target_enpassant = get_ls1b_index(enpassant_attacks);
-                            add_move(move_list, encode_move(source_square, target_enpassant, piece, 0, 1, 0, 1, 0));
+                            add_move(move_list, encode_move(source_square, target_enpassant, enpassant_flag));
                         }
                     }
                     
                     // pop ls1b from piece bitboard copy
-                    pop_bit(bitboard, source_square);
+                    pop_ls1b(bitboard);
                 }
                 
             }
             
-            // castling moves
-            if (piece == K)
+            // castling moves (king can't castle out of check)
+            if (piece == K && !checkers && stage != gen_captures)
             {
                 // king side castling is vailable
-                if (castle & wk)
+                if (pos->castle & wk)
                 {
                     // make sure square between king and king's rook are empty
-                    if (!get_bit(occupancies[both], f1) && !get_bit(occupancies[both], g1))
+                    if (!get_bit(get_occupancy(pos, both), f1) && !get_bit(get_occupancy(pos, both), g1))
                     {
-                        // make sure king and the f1 squares are not under attacks
-                        if (!is_square_attacked(e1, black) && !is_square_attacked(f1, black))
+                        // make sure king passes and lands on squares which are not under attacks
+#ifdef USE_ATTACK_MAP
+                        if (!(attacked & ((1ULL << f1) | (1ULL << g1))))
+#else
+                        if (!is_square_attacked(pos, f1, black) && !is_square_attacked(pos, g1, black))
+#endif
                         {
-                            add_move(move_list, encode_move(e1, g1, piece, 0, 0, 0, 0, 1));
+                            add_move(move_list, encode_move(e1, g1, king_castle_flag));
                         }
                         
                     }
@@ -1989,15 +3377,19 @@ static inline void generate_moves(moves *move_list) {
                 }
                 
                 // queen side castling is available
-                if (castle & wq)
+                if (pos->castle & wq)
                 {
                     // make sure square between queen and queen's rook are empty
-                    if (!get_bit(occupancies[both], d1) && !get_bit(occupancies[both], c1) && !get_bit(occupancies[both], b1))
+                    if (!get_bit(get_occupancy(pos, both), d1) && !get_bit(get_occupancy(pos, both), c1) && !get_bit(get_occupancy(pos, both), b1))
                     {
-                        // make sure queen and the d1 squares are not under attacks
-                        if (!is_square_attacked(e1, black) && !is_square_attacked(d1, black))
+                        // make sure king passes and lands on squares which are not under attacks
+#ifdef USE_ATTACK_MAP
+                        if (!(attacked & ((1ULL << d1) | (1ULL << c1))))
+#else
+                        if (!is_square_attacked(pos, d1, black) && !is_square_attacked(pos, c1, black))
+#endif
                         {
-                            add_move(move_list, encode_move(e1, c1, piece, 0, 0, 0, 0, 1));
+                            add_move(move_list, encode_move(e1, c1, queen_castle_flag));
                         }
                         
                     }
@@ -2019,34 +3411,43 @@ static inline void generate_moves(moves *move_list) {
                     // init source square
                     source_square = get_ls1b_index(bitboard);
                     
+                    // init squares current pawn may land on (pinned pawns stay on the pin line)
+                    U64 legal_targets = check_mask;
+                    if (get_bit(pinned, source_square)) legal_targets &= line_masks[king_square][source_square];
+
                     // init target square
                     target_square = source_square + 8;
                     
                     // generate quiet pawn moves
-                    if (!(target_square > h1) && !get_bit(occupancies[both], target_square))
+                    if (!(target_square > h1) && !get_bit(get_occupancy(pos, both), target_square))
                     {
                         // pawn promotion
                         if (source_square >= a2 && source_square <= h2)
                         {
-                            add_move(move_list, encode_move(source_square, target_square, piece, q, 0, 0, 0, 0));
-                            add_move(move_list, encode_move(source_square, target_square, piece, r, 0, 0, 0, 0));
-                            add_move(move_list, encode_move(source_square, target_square, piece, b, 0, 0, 0, 0));
-                            add_move(move_list, encode_move(source_square, target_square, piece, n, 0, 0, 0, 0));
+                            // promotion square is legal (promotions belong to captures stage)
+                            if (stage != gen_quiets && get_bit(legal_targets, target_square))
+                            {
+                                add_move(move_list, encode_move(source_square, target_square, queen_promotion_flag));
+                                add_move(move_list, encode_move(source_square, target_square, rook_promotion_flag));
+                                add_move(move_list, encode_move(source_square, target_square, bishop_promotion_flag));
+                                add_move(move_list, encode_move(source_square, target_square, knight_promotion_flag));
+                            }
                         }
                         
-                        else
+                        else if (stage != gen_captures)
                         {
                             // one square ahead pawn move
-                            add_move(move_list, encode_move(source_square, target_square, piece, 0, 0, 0, 0, 0));
+                            if (get_bit(legal_targets, target_square))
+                                add_move(move_list, encode_move(source_square, target_square, quiet_flag));
                             
                             // two squares ahead pawn move
-                            if ((source_square >= a7 && source_square <= h7) && !get_bit(occupancies[both], target_square + 8))
-                                add_move(move_list, encode_move(source_square, target_square + 8, piece, 0, 0, 1, 0, 0));
+                            if ((source_square >= a7 && source_square <= h7) && !get_bit(get_occupancy(pos, both), target_square + 8) && get_bit(legal_targets, target_square + 8))
+                                add_move(move_list, encode_move(source_square, target_square + 8, double_push_flag));
                         }
                     }
                     
-                    // init pawn attacks bitboard
-                    attacks = pawn_attacks[side][source_square] & occupancies[white];
+                    // init pawn attacks bitboard (no captures in quiets stage)
+                    attacks = (stage != gen_quiets) ? pawn_attacks[side][source_square] & get_occupancy(pos, white) & legal_targets : 0ULL;
                     
                     // generate pawn captures
                     while (attacks)
@@ -2057,53 +3458,57 @@ static inline void generate_moves(moves *move_list) {
                         // pawn promotion
                         if (source_square >= a2 && source_square <= h2)
                         {
-                            add_move(move_list, encode_move(source_square, target_square, piece, q, 1, 0, 0, 0));
-                            add_move(move_list, encode_move(source_square, target_square, piece, r, 1, 0, 0, 0));
-                            add_move(move_list, encode_move(source_square, target_square, piece, b, 1, 0, 0, 0));
-                            add_move(move_list, encode_move(source_square, target_square, piece, n, 1, 0, 0, 0));
+                            add_move(move_list, encode_move(source_square, target_square, queen_promotion_flag | capture_flag));
+                            add_move(move_list, encode_move(source_square, target_square, rook_promotion_flag | capture_flag));
+                            add_move(move_list, encode_move(source_square, target_square, bishop_promotion_flag | capture_flag));
+                            add_move(move_list, encode_move(source_square, target_square, knight_promotion_flag | capture_flag));
                         }
                         
                         else
                             // one square ahead pawn move
-                            add_move(move_list, encode_move(source_square, target_square, piece, 0, 1, 0, 0, 0));
+                            add_move(move_list, encode_move(source_square, target_square, capture_flag));
                         
                         // pop ls1b of the pawn attacks
-                        pop_bit(attacks, target_square);
+                        pop_ls1b(attacks);
                     }
                     
                     // generate enpassant captures
-                    if (enpassant != no_sq)
+                    if (stage != gen_quiets && pos->enpassant != no_sq)
                     {
                         // lookup pawn attacks and bitwise AND with enpassant square (bit)
-                        U64 enpassant_attacks = pawn_attacks[side][source_square] & (1ULL << enpassant);
+                        U64 enpassant_attacks = pawn_attacks[side][source_square] & (1ULL << pos->enpassant);
                         
-                        // make sure enpassant capture available
-                        if (enpassant_attacks)
+                        // make sure enpassant capture available and doesn't expose the king
+                        if (enpassant_attacks && is_enpassant_legal(pos, source_square, king_square, side))
                         {
                             // init enpassant capture target square
                             int target_enpassant = get_ls1b_index(enpassant_attacks);
-                            add_move(move_list, encode_move(source_square, target_enpassant, piece, 0, 1, 0, 1, 0));
+                            add_move(move_list, encode_move(source_square, target_enpassant, enpassant_flag));
                         }
                     }
                     
                     // pop ls1b from piece bitboard copy
-                    pop_bit(bitboard, source_square);
+                    pop_ls1b(bitboard);
                 }
             }
 
-            // castling moves
-            if (piece == k)
+            // castling moves (king can't castle out of check)
+            if (piece == k && !checkers && stage != gen_captures)
             {
                 // king side castling is vailable
-                if (castle & bk)
+                if (pos->castle & bk)
                 {
                     // make sure square between king and king's rook are empty
-                    if (!get_bit(occupancies[both], f8) && !get_bit(occupancies[both], g8))
+                    if (!get_bit(get_occupancy(pos, both), f8) && !get_bit(get_occupancy(pos, both), g8))
                     {
-                        // make sure king and the f8 squares are not under attacks
-                        if (!is_square_attacked(e8, white) && !is_square_attacked(f8, white))
+                        // make sure king passes and lands on squares which are not under attacks
+#ifdef USE_ATTACK_MAP
+                        if (!(attacked & ((1ULL << f8) | (1ULL << g8))))
+#else
+                        if (!is_square_attacked(pos, f8, white) && !is_square_attacked(pos, g8, white))
+#endif
                         {
-                            add_move(move_list, encode_move(e8, g8, piece, 0, 0, 0, 0, 1));
+                            add_move(move_list, encode_move(e8, g8, king_castle_flag));
                         }
                         
                     }
@@ -2111,15 +3516,19 @@ static inline void generate_moves(moves *move_list) {
                 }
                 
                 // queen side castling is available
-                if (castle & bq)
+                if (pos->castle & bq)
                 {
                     // make sure square between queen and queen's rook are empty
-                    if (!get_bit(occupancies[both], d8) && !get_bit(occupancies[both], c8) && !get_bit(occupancies[both], b8))
+                    if (!get_bit(get_occupancy(pos, both), d8) && !get_bit(get_occupancy(pos, both), c8) && !get_bit(get_occupancy(pos, both), b8))
                     {
-                        // make sure queen and the d8 squares are not under attacks
-                        if (!is_square_attacked(e8, white) && !is_square_attacked(d8, white))
+                        // make sure king passes and lands on squares which are not under attacks
+#ifdef USE_ATTACK_MAP
+                        if (!(attacked & ((1ULL << d8) | (1ULL << c8))))
+#else
+                        if (!is_square_attacked(pos, d8, white) && !is_square_attacked(pos, c8, white))
+#endif
                         {
-                            add_move(move_list, encode_move(e8, c8, piece, 0, 0, 0, 0, 1));
+                            add_move(move_list, encode_move(e8, c8, queen_castle_flag));
                         }
                         
                     }
@@ -2131,6 +3540,9 @@ static inline void generate_moves(moves *move_list) {
         // generate knight moves
         if ((side == white) ? piece == N : piece == n)
         {
+            // pinned knights can't move at all
+            bitboard &= ~pinned;
+
             // loop over source square of piece bitboard copy
             while (bitboard)
             {
@@ -2138,7 +3550,8 @@ static inline void generate_moves(moves *move_list) {
                 source_square = get_ls1b_index(bitboard);
 
                 // init piece attacks in order to get set of target square (if tertiary with bitwise ~ NOT)
-                attacks = knight_attacks[source_square] & ((side == white) ? ~occupancies[white] : ~occupancies[black]);
+                attacks = knight_attacks[source_square] & target_mask & check_mask;
+
 
                 // loop over target squares available from generated attacks
                 while (attacks)
@@ -2147,24 +3560,24 @@ static inline void generate_moves(moves *move_list) {
                     target_square = get_ls1b_index(attacks);
 
                     // quiet move
-                    if (!get_bit(((side == white) ? occupancies[black] : occupancies[white]), target_square))
+                    if (!get_bit(((side == white) ? get_occupancy(pos, black) : get_occupancy(pos, white)), target_square))
                     {
-                        add_move(move_list, encode_move(source_square, target_square, piece, 0, 0, 0, 0, 0));
+                        add_move(move_list, encode_move(source_square, target_square, quiet_flag));
                     }
 
                     else
                     {
                         // capture move
-                        add_move(move_list, encode_move(source_square, target_square, piece, 0, 1, 0, 0, 0));
+                        add_move(move_list, encode_move(source_square, target_square, capture_flag));
 
                     }
                     
                     // pop ls1b in current attacks set
-                    pop_bit(attacks, target_square);
+                    pop_ls1b(attacks);
                 }
                 
                 // pop ls1b of the current piece bitboard
-                pop_bit(bitboard, source_square);
+                pop_ls1b(bitboard);
             }
             
         }
@@ -2179,7 +3592,10 @@ static inline void generate_moves(moves *move_list) {
                 source_square = get_ls1b_index(bitboard);
 
                 // init piece attacks in order to get set of target square (if tertiary with bitwise ~ NOT)
-                attacks = get_bishop_attacks(source_square, occupancies[both]) & ((side == white) ? ~occupancies[white] : ~occupancies[black]);
+                attacks = get_bishop_attacks(source_square, get_occupancy(pos, both)) & target_mask & check_mask;
+
+                // pinned pieces stay on the pin line
+                if (get_bit(pinned, source_square)) attacks &= line_masks[king_square][source_square];
 
                 // loop over target squares available from generated attacks
                 while (attacks)
@@ -2188,24 +3604,24 @@ static inline void generate_moves(moves *move_list) {
                     target_square = get_ls1b_index(attacks);
 
                     // quiet move
-                    if (!get_bit(((side == white) ? occupancies[black] : occupancies[white]), target_square))
+                    if (!get_bit(((side == white) ? get_occupancy(pos, black) : get_occupancy(pos, white)), target_square))
                     {
-                        add_move(move_list, encode_move(source_square, target_square, piece, 0, 0, 0, 0, 0));
+                        add_move(move_list, encode_move(source_square, target_square, quiet_flag));
                     }
 
                     else
                     {
                         // capture move
-                        add_move(move_list, encode_move(source_square, target_square, piece, 0, 1, 0, 0, 0));
+                        add_move(move_list, encode_move(source_square, target_square, capture_flag));
 
                     }
                     
                     // pop ls1b in current attacks set
-                    pop_bit(attacks, target_square);
+                    pop_ls1b(attacks);
                 }
 
                 // pop ls1b of the current piece bitboard
-                pop_bit(bitboard, source_square);
+                pop_ls1b(bitboard);
             }
             
         }
@@ -2220,7 +3636,99 @@ static inline void generate_moves(moves *move_list) {
                 source_square = get_ls1b_index(bitboard);
 
                 // init piece attacks in order to get set of target square (if tertiary with bitwise ~ NOT)
-                attacks = get_rook_attacks(source_square, occupancies[both]) & ((side == white) ? ~occupancies[white] : ~occupancies[black]);
+                attacks = get_rook_attacks(source_square, get_occupancy(pos, both)) & target_mask & check_mask;
+
+                // pinned pieces stay on the pin line
+                if (get_bit(pinned, source_square)) attacks &= line_masks[king_square][source_square];
+
+                // loop over target squares available from generated attacks
+                while (attacks)
+                {
+                    // init target square
+                    target_square = get_ls1b_index(attacks);
+
+                    // quiet move
+                    if (!get_bit(((side == white) ? get_occupancy(pos, black) : get_occupancy(pos, white)), target_square))
+                    {
+                        add_move(move_list, encode_move(source_square, target_square, quiet_flag));
+                    }
+
+                    else
+                    {
+                        // capture move
+                        add_move(move_list, encode_move(source_square, target_square, capture_flag));
+
+                    }
+                    
+                    // pop ls1b in current attacks set
+                    pop_ls1b(attacks);
+                }
+
+                // pop ls1b of the current piece bitboard
+                pop_ls1b(bitboard);
+            }
+            
+        }
+
+        // generate queen moves
+        if ((side == white) ? piece == Q : piece == q)
+        {
+            // loop over source square of piece bitboard copy
+            while (bitboard)
+            {
+                // init source square and ls1b base on init bitboard from the if condition
+                source_square = get_ls1b_index(bitboard);
+
+                // init piece attacks in order to get set of target square (if tertiary with bitwise ~ NOT)
+                attacks = get_queen_attacks(source_square, get_occupancy(pos, both)) & target_mask & check_mask;
+
+                // pinned pieces stay on the pin line
+                if (get_bit(pinned, source_square)) attacks &= line_masks[king_square][source_square];
+
+                // loop over target squares available from generated attacks
+                while (attacks)
+                {
+                    // init target square
+                    target_square = get_ls1b_index(attacks);
+
+                    // quiet move
+                    if (!get_bit(((side == white) ? get_occupancy(pos, black) : get_occupancy(pos, white)), target_square))
+                    {
+                        add_move(move_list, encode_move(source_square, target_square, quiet_flag));
+                    }
+
+                    else
+                    {
+                        // capture move
+                        add_move(move_list, encode_move(source_square, target_square, capture_flag));
+                    }
+                    
+                    // pop ls1b in current attacks set
+                    pop_ls1b(attacks);
+                }
+
+                // pop ls1b of the current piece bitboard
+                pop_ls1b(bitboard);
+            }
+            
+        }
+
+        // generate king moves
+        if ((side == white) ? piece == K : piece == k)
+        {
+            // loop over source square of piece bitboard copy
+            while (bitboard)
+            {
+                // init source square and ls1b base on init bitboard from the if condition
+                source_square = get_ls1b_index(bitboard);
+
+                // init piece attacks in order to get set of target square (if tertiary with bitwise ~ NOT)
+                attacks = king_attacks[source_square] & target_mask;
+
+#ifdef USE_ATTACK_MAP
+                // king can't step into attack
+                attacks &= ~attacked;
+#endif
 
                 // loop over target squares available from generated attacks
                 while (attacks)
@@ -2228,217 +3736,1595 @@ static inline void generate_moves(moves *move_list) {
                     // init target square
                     target_square = get_ls1b_index(attacks);
 
-                    // quiet move
-                    if (!get_bit(((side == white) ? occupancies[black] : occupancies[white]), target_square))
-                    {
-                        add_move(move_list, encode_move(source_square, target_square, piece, 0, 0, 0, 0, 0));
-                    }
+#ifndef USE_ATTACK_MAP
+                    // king can't step into attack (king itself doesn't block sliders' rays behind it)
+                    if (is_king_step_attacked(pos, target_square, source_square, side ^ 1))
+                    {
+                        // pop ls1b in current attacks set
+                        pop_ls1b(attacks);
+                        continue;
+                    }
+#endif
+
+                    // quiet move
+                    if (!get_bit(((side == white) ? get_occupancy(pos, black) : get_occupancy(pos, white)), target_square))
+                    {
+                        add_move(move_list, encode_move(source_square, target_square, quiet_flag));
+                    }
+
+                    else
+                    {
+                        // capture move
+                        add_move(move_list, encode_move(source_square, target_square, capture_flag));
+                    }
+                    
+                    // pop ls1b in current attacks set
+                    pop_ls1b(attacks);
+                }
+
+                // pop ls1b of the current piece bitboard
+                pop_ls1b(bitboard);
+            }
+            
+        }
+    }
+    
+}
+
+// add pawn move to the move list (expands promotions)
+force_inline void add_pawn_move(moves *move_list, int source_square, int target_square, int capture) {
+
+    // init capture flag
+    int flags = capture ? capture_flag : quiet_flag;
+
+    // pawn reaches last rank
+    if (target_square <= h8 || target_square >= a1)
+    {
+        add_move(move_list, encode_move(source_square, target_square, queen_promotion_flag | flags));
+        add_move(move_list, encode_move(source_square, target_square, rook_promotion_flag | flags));
+        add_move(move_list, encode_move(source_square, target_square, bishop_promotion_flag | flags));
+        add_move(move_list, encode_move(source_square, target_square, knight_promotion_flag | flags));
+    }
+
+    // regular pawn move
+    else
+        add_move(move_list, encode_move(source_square, target_square, flags));
+}
+
+// generate legal check evasions (side to move must be in check)
+force_inline void generate_evasions_info(position *pos, moves *move_list, check_info *info, const int side) {
+
+    // init move count
+    move_list->count = 0;
+
+    // init source & target squares
+    int source_square, target_square;
+
+    // init king square
+    int king_square = info->king_square;
+
+    // init king attacks (king can't capture own pieces)
+    U64 attacks = king_attacks[king_square] & ~get_occupancy(pos, side);
+
+#ifdef USE_ATTACK_MAP
+    // king can't step into attack (king itself doesn't block sliders' rays behind it)
+    attacks &= ~get_attack_map(pos, side ^ 1, get_occupancy(pos, both) ^ (1ULL << king_square));
+#endif
+
+    // loop over king target squares
+    while (attacks)
+    {
+        // init target square
+        target_square = get_ls1b_index(attacks);
+
+#ifndef USE_ATTACK_MAP
+        // king can't step into attack (king itself doesn't block sliders' rays behind it)
+        if (is_king_step_attacked(pos, target_square, king_square, side ^ 1))
+        {
+            // pop ls1b in current attacks set
+            pop_ls1b(attacks);
+            continue;
+        }
+#endif
+
+        // capture move
+        if (get_bit(get_occupancy(pos, side ^ 1), target_square))
+            add_move(move_list, encode_move(king_square, target_square, capture_flag));
+
+        // quiet move
+        else
+            add_move(move_list, encode_move(king_square, target_square, quiet_flag));
+
+        // pop ls1b in current attacks set
+        pop_ls1b(attacks);
+    }
+
+    // double check (only king moves)
+    if (info->checkers & (info->checkers - 1)) return;
+
+    // init checker square
+    int checker_square = get_ls1b_index(info->checkers);
+
+    // init friendly pieces & pawns able to resolve check (pinned pieces never can)
+    U64 movable = get_occupancy(pos, side) & ~info->pinned;
+    U64 pawns = get_bitboard(pos, (side == white) ? P : p) & movable;
+
+    // init friendly sliders & knights
+    U64 bishops = (side == white) ? (get_bitboard(pos, B) | get_bitboard(pos, Q)) : (get_bitboard(pos, b) | get_bitboard(pos, q));
+    U64 rooks = (side == white) ? (get_bitboard(pos, R) | get_bitboard(pos, Q)) : (get_bitboard(pos, r) | get_bitboard(pos, q));
+    U64 knights = get_bitboard(pos, (side == white) ? N : n);
+
+    // init squares to capture the checker on or block its ray
+    U64 targets = info->check_mask;
+
+    // loop over target squares
+    while (targets)
+    {
+        // init target square
+        target_square = get_ls1b_index(targets);
+
+        // capturing the checker or blocking
+        int capture = (target_square == checker_square);
+
+        // init pieces (except pawns & king) reaching target square
+        U64 defenders = ((knight_attacks[target_square] & knights) |
+                         (get_bishop_attacks(target_square, get_occupancy(pos, both)) & bishops) |
+                         (get_rook_attacks(target_square, get_occupancy(pos, both)) & rooks)) & movable;
+
+        // loop over defenders
+        while (defenders)
+        {
+            // init source square
+            source_square = get_ls1b_index(defenders);
+
+            // add move
+            add_move(move_list, encode_move(source_square, target_square, capture ? capture_flag : quiet_flag));
+
+            // pop ls1b of defenders
+            pop_ls1b(defenders);
+        }
+
+        // pawns capture the checker
+        if (capture)
+        {
+            // init pawns attacking the checker
+            U64 attackers = pawn_attacks[side ^ 1][target_square] & pawns;
+
+            // loop over attacking pawns
+            while (attackers)
+            {
+                // init source square
+                source_square = get_ls1b_index(attackers);
+
+                // add pawn capture
+                add_pawn_move(move_list, source_square, target_square, 1);
+
+                // pop ls1b of attacking pawns
+                pop_ls1b(attackers);
+            }
+        }
+
+        // pawns block the checker's ray
+        else
+        {
+            // init pawn push source square
+            source_square = (side == white) ? target_square + 8 : target_square - 8;
+
+            // single pawn push
+            if (get_bit(pawns, source_square))
+                add_pawn_move(move_list, source_square, target_square, 0);
+
+            // double pawn push (from 2nd/7th rank over an empty square)
+            else if (!get_bit(get_occupancy(pos, both), source_square))
+            {
+                // white pawns land on 4th rank
+                if (side == white && target_square >= a4 && target_square <= h4 && get_bit(pawns, target_square + 16))
+                    add_move(move_list, encode_move(target_square + 16, target_square, double_push_flag));
+
+                // black pawns land on 5th rank
+                if (side == black && target_square >= a5 && target_square <= h5 && get_bit(pawns, target_square - 16))
+                    add_move(move_list, encode_move(target_square - 16, target_square, double_push_flag));
+            }
+        }
+
+        // pop ls1b of target squares
+        pop_ls1b(targets);
+    }
+
+    // enpassant captures (removing the double pushed checker or blocking a discovered check)
+    if (pos->enpassant != no_sq)
+    {
+        // init pawns attacking enpassant square (pins are verified by enpassant legality test)
+        U64 attackers = pawn_attacks[side ^ 1][pos->enpassant] & get_bitboard(pos, (side == white) ? P : p);
+
+        // loop over attacking pawns
+        while (attackers)
+        {
+            // init source square
+            source_square = get_ls1b_index(attackers);
+
+            // make sure enpassant capture doesn't expose the king
+            if (is_enpassant_legal(pos, source_square, king_square, side))
+                add_move(move_list, encode_move(source_square, pos->enpassant, enpassant_flag));
+
+            // pop ls1b of attacking pawns
+            pop_ls1b(attackers);
+        }
+    }
+}
+
+// generate all legal moves (side specialized body)
+force_inline void generate_moves_side(position *pos, moves *move_list, const int side) {
+
+    // init check & pin information
+    check_info info[1];
+    init_check_info(pos, info, side);
+
+    // side to move is in check
+    if (info->checkers)
+        // generate check evasions only
+        generate_evasions_info(pos, move_list, info, side);
+
+    // otherwise generate captures & quiets in one pass
+    else
+        generate_stage_moves(pos, move_list, info, gen_all, side);
+}
+
+// generate legal moves of the given stage, check evasions if stage is gen_evasions (side specialized body)
+force_inline void generate_stage_side(position *pos, moves *move_list, const int stage, const int side) {
+
+    // init check & pin information
+    check_info info[1];
+    init_check_info(pos, info, side);
+
+    // side to move is in check & evasions requested
+    if (stage == gen_evasions && info->checkers)
+        generate_evasions_info(pos, move_list, info, side);
+
+    // captures, quiets or all legal moves (evasions fall back to all legal moves when not in check)
+    else
+        generate_stage_moves(pos, move_list, info, (stage == gen_evasions) ? gen_all : stage, side);
+}
+
+// white & black move generators
+static void generate_white_moves(position *pos, moves *move_list) { generate_moves_side(pos, move_list, white); }
+static void generate_black_moves(position *pos, moves *move_list) { generate_moves_side(pos, move_list, black); }
+
+// generate all legal moves (pick side specialized generator once per node)
+static inline void generate_moves(position *pos, moves *move_list) {
+
+    // white to move
+    if (pos->side == white)
+        generate_white_moves(pos, move_list);
+
+    // black to move
+    else
+        generate_black_moves(pos, move_list);
+}
+
+// generate legal captures, enpassant & promotions only
+static inline void generate_captures(position *pos, moves *move_list) {
+
+    // pick side specialized captures stage
+    (pos->side == white) ? generate_stage_side(pos, move_list, gen_captures, white)
+                         : generate_stage_side(pos, move_list, gen_captures, black);
+}
+
+// generate legal quiet moves only (no promotions)
+static inline void generate_quiets(position *pos, moves *move_list) {
+
+    // pick side specialized quiets stage
+    (pos->side == white) ? generate_stage_side(pos, move_list, gen_quiets, white)
+                         : generate_stage_side(pos, move_list, gen_quiets, black);
+}
+
+// generate legal check evasions (all legal moves if side to move isn't in check)
+static inline void generate_evasions(position *pos, moves *move_list) {
+
+    // pick side specialized evasions stage
+    (pos->side == white) ? generate_stage_side(pos, move_list, gen_evasions, white)
+                         : generate_stage_side(pos, move_list, gen_evasions, black);
+}
+
+#ifdef DEBUG
+
+// count move occurrences within a move list
+static int count_move(moves *move_list, int move) {
+
+    // init move count
+    int count = 0;
+
+    // loop over moves within a move list
+    for (int index = 0; index < move_list->count; index++)
+        count += move_list->moves[index].move == move;
+
+    // return move count
+    return count;
+}
+
+// make sure captures + quiets stages and evasions stage generate exactly the full legal move list
+static void check_stage_moves(position *pos, moves *move_list) {
+
+    // generate captures, quiets & evasions stages
+    moves captures[1], quiets[1], evasions[1];
+    generate_captures(pos, captures);
+    generate_quiets(pos, quiets);
+    generate_evasions(pos, evasions);
+
+    // every move comes from exactly one of captures & quiets, evasions match all moves
+    int fail = captures->count + quiets->count != move_list->count || evasions->count != move_list->count;
+    for (int index = 0; !fail && index < move_list->count; index++)
+    {
+        int move = move_list->moves[index].move;
+        if (count_move(captures, move) + count_move(quiets, move) != 1 || count_move(evasions, move) != 1)
+            fail = 1;
+    }
+
+    // report mismatch
+    if (fail)
+    {
+        printf("\n\n     Stage moves mismatch: %d all, %d captures, %d quiets, %d evasions\n",
+               move_list->count, captures->count, quiets->count, evasions->count);
+        print_board(pos);
+    }
+}
+
+#endif
+
+/*************************************************\
+===================================================
+                Batched Move Generation
+===================================================
+\*************************************************/
+
+/*
+    Batches keep many unrelated positions in a structure of arrays layout, every
+    position seen from the side to move (black to move positions are flipped
+    vertically & colors swapped), so all lanes push pawns towards rank 8 and
+    castle on rank 1.
+
+    With AVX2 legal moves are counted for 4 positions per register: set-wise pawn,
+    king & castling targets, knight & slider targets piece by piece gathered from
+    knight_attacks & magic tables, checks, pins & enemy attacks by Kogge-Stone
+    fills. Positions with an enpassant capture available (and the batch tail)
+    fall back to generate_moves()
+
+    UCI "bench batch" times both against each other on the same positions
+*/
+
+// positions per batch
+#define batch_size 256
+
+// positions per AVX2 register
+#define batch_lanes 4
+
+// positions batch (structure of arrays)
+typedef struct __attribute__((aligned(32))) {
+    // piece bitboards [side to move, opponent][pawn .. king][position]
+    U64 pieces[2][6][batch_size];
+
+    // castling rights (wk, wq: side to move, bk, bq: opponent) [position]
+    U64 castle[batch_size];
+
+    // enpassant square bitboard (0 if none) [position]
+    U64 enpassant[batch_size];
+
+    // side to move of the original position [position]
+    unsigned char side[batch_size];
+
+    // positions in batch
+    int count;
+} position_batch;
+
+// add position to batch (returns position's index, -1 if batch is full)
+int add_batch_position(position_batch *batch, position *pos) {
+
+    // batch is full
+    if (batch->count == batch_size) return -1;
+
+    // init position's index & side to move
+    int index = batch->count++;
+    int side = pos->side;
+
+    // loop over piece bitboards
+    for (int piece = P; piece <= k; piece++)
+    {
+        // flip black to move positions vertically (byte swap mirrors ranks)
+        U64 bitboard = get_bitboard(pos, piece);
+        batch->pieces[(piece >= p) ^ side][piece % 6][index] = side ? __builtin_bswap64(bitboard) : bitboard;
+    }
+
+    // swap castling rights & flip enpassant square of black to move positions
+    batch->castle[index] = side ? ((pos->castle >> 2) | ((pos->castle & 3) << 2)) : pos->castle;
+    batch->enpassant[index] = (pos->enpassant == no_sq) ? 0ULL : 1ULL << (side ? pos->enpassant ^ 56 : pos->enpassant);
+    batch->side[index] = side;
+
+    // return position's index
+    return index;
+}
+
+// get position from batch (reverse of add_batch_position)
+void get_batch_position(position_batch *batch, int index, position *pos) {
+
+    // init side to move
+    int side = batch->side[index];
+
+#ifdef QUAD_BITBOARDS
+    // reset board position (quad bitboards, occupancies are derived from them)
+    memset(pos->quad, 0ULL, sizeof(pos->quad));
+#else
+    // reset board position & occupancies
+    memset(pos->bitboards, 0ULL, sizeof(pos->bitboards));
+    memset(pos->occupancies, 0ULL, sizeof(pos->occupancies));
+#endif
+
+    // reset mailbox (empty squares)
+    memset(pos->mailbox, no_piece, sizeof(pos->mailbox));
+
+    // loop over piece bitboards
+    for (int piece = P; piece <= k; piece++)
+    {
+        // flip black to move positions back
+        U64 bitboard = batch->pieces[(piece >= p) ^ side][piece % 6][index];
+        if (side) bitboard = __builtin_bswap64(bitboard);
+
+        // loop over pieces
+        while (bitboard)
+        {
+            // put piece on board, occupancies & mailbox
+            int square = get_ls1b_index(bitboard);
+            set_piece(pos, piece, square);
+            toggle_occupancy(pos, (piece >= p) ? black : white, 1ULL << square);
+            pos->mailbox[square] = piece;
+
+            // pop ls1b
+            pop_ls1b(bitboard);
+        }
+    }
+
+    // restore game state variables
+    U64 castle = batch->castle[index];
+    pos->side = side;
+    pos->castle = side ? ((castle >> 2) | ((castle & 3) << 2)) : castle;
+    pos->enpassant = batch->enpassant[index] ? get_ls1b_index(batch->enpassant[index]) ^ (side ? 56 : 0) : no_sq;
+
+#ifdef MAKE_UNMAKE
+    // reset undo stack
+    pos->ply = 0;
+#endif
+
+    // init hash key
+    pos->hash_key = generate_hash_key(pos);
+
+#ifdef ATTACK_BOARDS
+    // init attack boards
+    init_attack_boards(pos);
+#endif
+}
+
+// count legal moves of one batch position with the regular move generator
+static int count_batch_position(position_batch *batch, int index) {
+
+    // rebuild position
+    position pos[1];
+    get_batch_position(batch, index, pos);
+
+    // generate legal moves
+    moves move_list[1];
+    generate_moves(pos, move_list);
+
+    // return legal moves count
+    return move_list->count;
+}
+
+#ifdef USE_AVX2
+
+// count bits of 4 lanes (nibble lookup, bytes summed per lane)
+static inline __m256i batch_count_bits(__m256i bitboards) {
+
+    // init nibble bit counts & low nibble mask
+    const __m256i lookup = _mm256_setr_epi8(0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4,
+                                            0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4);
+    const __m256i low_nibbles = _mm256_set1_epi8(0x0f);
+
+    // count bits of low & high nibbles
+    __m256i counts = _mm256_add_epi8(_mm256_shuffle_epi8(lookup, _mm256_and_si256(bitboards, low_nibbles)),
+                                     _mm256_shuffle_epi8(lookup, _mm256_and_si256(_mm256_srli_epi16(bitboards, 4), low_nibbles)));
+
+    // sum up byte counts of every lane
+    return _mm256_sad_epu8(counts, _mm256_setzero_si256());
+}
+
+// get square index of 4 single bit lanes (square 0 for empty lanes)
+static inline __m256i batch_ls1b_index(__m256i ls1b) {
+
+    // count trailing zeros (empty lanes count 64 bits)
+    return _mm256_and_si256(batch_count_bits(_mm256_sub_epi64(ls1b, _mm256_set1_epi64x(1))), _mm256_set1_epi64x(63));
+}
+
+// get all ones in lanes where bitboard isn't empty
+static inline __m256i batch_not_empty(__m256i bitboards) {
+    return _mm256_xor_si256(_mm256_cmpeq_epi64(bitboards, _mm256_setzero_si256()), _mm256_set1_epi64x(-1));
+}
+
+// shift 4 lanes (positive shift: left, negative shift: right) and cut off wrapped squares
+static inline __m256i batch_shift(__m256i bitboards, int shift, U64 mask) {
+    bitboards = (shift > 0) ? _mm256_sll_epi64(bitboards, _mm_cvtsi32_si128(shift))
+                            : _mm256_srl_epi64(bitboards, _mm_cvtsi32_si128(-shift));
+    return _mm256_and_si256(bitboards, _mm256_set1_epi64x(mask));
+}
+
+// multiply 4 lanes (low 64 bits of product, AVX2 only multiplies 32 bit halves)
+static inline __m256i batch_multiply(__m256i a, __m256i b) {
+    __m256i cross = _mm256_add_epi64(_mm256_mul_epu32(_mm256_srli_epi64(a, 32), b),
+                                     _mm256_mul_epu32(a, _mm256_srli_epi64(b, 32)));
+    return _mm256_add_epi64(_mm256_mul_epu32(a, b), _mm256_slli_epi64(cross, 32));
+}
+
+// get knight attacks of 4 lanes (set-wise)
+static inline __m256i batch_knight_attacks(__m256i knights) {
+    return _mm256_or_si256(_mm256_or_si256(_mm256_or_si256(batch_shift(knights, -17, not_h_file), batch_shift(knights, -15, not_a_file)),
+                                           _mm256_or_si256(batch_shift(knights, -10, not_gh_file), batch_shift(knights, -6, not_ab_file))),
+                           _mm256_or_si256(_mm256_or_si256(batch_shift(knights, 17, not_a_file), batch_shift(knights, 15, not_h_file)),
+                                           _mm256_or_si256(batch_shift(knights, 10, not_ab_file), batch_shift(knights, 6, not_gh_file))));
+}
+
+// get king attacks of 4 lanes (set-wise)
+static inline __m256i batch_king_attacks(__m256i kings) {
+    return _mm256_or_si256(_mm256_or_si256(_mm256_or_si256(batch_shift(kings, 1, not_a_file), batch_shift(kings, -1, not_h_file)),
+                                           _mm256_or_si256(batch_shift(kings, 8, ~0ULL), batch_shift(kings, -8, ~0ULL))),
+                           _mm256_or_si256(_mm256_or_si256(batch_shift(kings, 9, not_a_file), batch_shift(kings, -9, not_h_file)),
+                                           _mm256_or_si256(batch_shift(kings, 7, not_h_file), batch_shift(kings, -7, not_a_file))));
+}
+
+// get attacks of generators along one direction for 4 lanes (see get_fill_attacks)
+static inline __m256i batch_fill_attacks(__m256i generator, __m256i empty, int shift, U64 mask) {
+
+    // init propagator (empty squares generators can spread through)
+    __m256i propagator = _mm256_and_si256(empty, _mm256_set1_epi64x(mask));
+
+    // spread generators 1, 2 & 4 squares
+    generator = _mm256_or_si256(generator, _mm256_and_si256(propagator, batch_shift(generator, shift, ~0ULL)));
+    propagator = _mm256_and_si256(propagator, batch_shift(propagator, shift, ~0ULL));
+    generator = _mm256_or_si256(generator, _mm256_and_si256(propagator, batch_shift(generator, shift * 2, ~0ULL)));
+    propagator = _mm256_and_si256(propagator, batch_shift(propagator, shift * 2, ~0ULL));
+    generator = _mm256_or_si256(generator, _mm256_and_si256(propagator, batch_shift(generator, shift * 4, ~0ULL)));
+
+    // attacks are one step past the fill
+    return batch_shift(generator, shift, mask);
+}
+
+// get attacks of all sliders in 4 lanes
+static inline __m256i batch_sliders_attacks(__m256i rooks, __m256i bishops, __m256i empty) {
+    return _mm256_or_si256(_mm256_or_si256(_mm256_or_si256(batch_fill_attacks(rooks, empty, 1, not_a_file), batch_fill_attacks(rooks, empty, 8, ~0ULL)),
+                                           _mm256_or_si256(batch_fill_attacks(rooks, empty, -1, not_h_file), batch_fill_attacks(rooks, empty, -8, ~0ULL))),
+                           _mm256_or_si256(_mm256_or_si256(batch_fill_attacks(bishops, empty, 9, not_a_file), batch_fill_attacks(bishops, empty, 7, not_h_file)),
+                                           _mm256_or_si256(batch_fill_attacks(bishops, empty, -9, not_h_file), batch_fill_attacks(bishops, empty, -7, not_a_file))));
+}
+
+// get pieces pinned along one direction from king for 4 lanes (adds enemy sliders giving check to checkers)
+static inline __m256i batch_pinned_pieces(__m256i king, __m256i empty, __m256i own, __m256i snipers,
+                                          int shift, U64 mask, __m256i *checkers) {
+
+    // init first piece on king's ray
+    __m256i ray = batch_fill_attacks(king, empty, shift, mask);
+
+    // enemy slider giving check
+    *checkers = _mm256_or_si256(*checkers, _mm256_and_si256(ray, snipers));
+
+    // first piece on king's ray belongs to side to move
+    __m256i candidates = _mm256_and_si256(ray, own);
+
+    // enemy slider stands right behind it
+    __m256i pinners = _mm256_and_si256(batch_fill_attacks(candidates, empty, shift, mask), snipers);
+
+    // return pinned pieces
+    return _mm256_and_si256(candidates, batch_not_empty(pinners));
+}
+
+// get slider attacks of 4 lanes (bishop or rook)
+static inline __m256i batch_slider_attacks(const int slider, __m256i square, __m256i occupancy) {
+
+#if defined(USE_PEXT) || defined(HYPERBOLA_QUINTESSENCE)
+    // no vector PEXT or byte swapped subtraction, look up lanes one by one
+    U64 squares[batch_lanes] __attribute__((aligned(32)));
+    U64 occupancies[batch_lanes] __attribute__((aligned(32)));
+    U64 attacks[batch_lanes] __attribute__((aligned(32)));
+    _mm256_store_si256((__m256i *)squares, square);
+    _mm256_store_si256((__m256i *)occupancies, occupancy);
+    for (int lane = 0; lane < batch_lanes; lane++)
+        attacks[lane] = (slider == bishop) ? get_bishop_attacks(squares[lane], occupancies[lane])
+                                           : get_rook_attacks(squares[lane], occupancies[lane]);
+    return _mm256_load_si256((const __m256i *)attacks);
+#else
+    // gather lookup entries' fields (4 quad words per entry)
+    const long long *fields = (const long long *)((slider == bishop) ? bishop_magics : rook_magics);
+    __m256i entry = _mm256_slli_epi64(square, 2);
+    __m256i mask = _mm256_i64gather_epi64(fields, entry, 8);
+    __m256i magic = _mm256_i64gather_epi64(fields + 1, entry, 8);
+    __m256i slice = _mm256_i64gather_epi64(fields + 2, entry, 8);
+    __m256i shift = _mm256_and_si256(_mm256_i64gather_epi64(fields + 3, entry, 8), _mm256_set1_epi64x(63));
+
+    // mask relevant occupancy, multiply by magic, keep relevant bits
+    __m256i index = _mm256_srlv_epi64(batch_multiply(_mm256_and_si256(occupancy, mask), magic), shift);
+
+    // slices point into shared slider attacks table
+    index = _mm256_add_epi64(_mm256_srli_epi64(_mm256_sub_epi64(slice, _mm256_set1_epi64x((long long)slider_attacks)), 3), index);
+
+    // gather attacks
+    return _mm256_i64gather_epi64((const long long *)slider_attacks, index, 8);
+#endif
+}
+
+// count legal moves of pawns in 4 lanes landing on allowed squares (single source per target & direction)
+static inline __m256i batch_count_pawn_moves(__m256i pawns, __m256i empty, __m256i enemy, __m256i allowed) {
+
+    // init pushes & captures (double pushes pass through rank 3)
+    __m256i single_pushes = _mm256_and_si256(batch_shift(pawns, -8, ~0ULL), empty);
+    __m256i double_pushes = _mm256_and_si256(batch_shift(single_pushes, -8, 0xffULL << a4), empty);
+    __m256i left_captures = _mm256_and_si256(batch_shift(pawns, -9, not_h_file), enemy);
+    __m256i right_captures = _mm256_and_si256(batch_shift(pawns, -7, not_a_file), enemy);
+
+    // keep allowed targets only
+    single_pushes = _mm256_and_si256(single_pushes, allowed);
+    double_pushes = _mm256_and_si256(double_pushes, allowed);
+    left_captures = _mm256_and_si256(left_captures, allowed);
+    right_captures = _mm256_and_si256(right_captures, allowed);
+
+    // count moves
+    __m256i count = _mm256_add_epi64(_mm256_add_epi64(batch_count_bits(single_pushes), batch_count_bits(double_pushes)),
+                                     _mm256_add_epi64(batch_count_bits(left_captures), batch_count_bits(right_captures)));
+
+    // promotions add 3 under promotions each
+    const __m256i rank_8 = _mm256_set1_epi64x(0xffULL);
+    __m256i promotions = _mm256_add_epi64(batch_count_bits(_mm256_and_si256(single_pushes, rank_8)),
+                                  _mm256_add_epi64(batch_count_bits(_mm256_and_si256(left_captures, rank_8)),
+                                                   batch_count_bits(_mm256_and_si256(right_captures, rank_8))));
+
+    // return move counts
+    return _mm256_add_epi64(count, _mm256_add_epi64(promotions, _mm256_slli_epi64(promotions, 1)));
+}
+
+// count legal moves of pieces in 4 lanes piece by piece (pawns, knights, bishops or rooks, queens move as both)
+static inline __m256i batch_count_piece_moves(__m256i pieces, const int piece, __m256i allowed, __m256i empty, __m256i enemy,
+                                              __m256i pinned, __m256i king_square) {
+
+    // init move counts & occupancy
+    __m256i count = _mm256_setzero_si256();
+    __m256i occupancy = _mm256_xor_si256(empty, _mm256_set1_epi64x(-1));
+
+    // loop over pieces while any lane has one left
+    while (!_mm256_testz_si256(pieces, pieces))
+    {
+        // isolate & pop ls1b of every lane
+        __m256i ls1b = _mm256_and_si256(pieces, _mm256_sub_epi64(_mm256_setzero_si256(), pieces));
+        pieces = _mm256_xor_si256(pieces, ls1b);
+
+        // init piece square
+        __m256i square = batch_ls1b_index(ls1b);
+
+        // pinned pieces move along the pin line only, lanes without a piece don't move at all
+        __m256i line = _mm256_i64gather_epi64((const long long *)line_masks, _mm256_add_epi64(_mm256_slli_epi64(king_square, 6), square), 8);
+        __m256i landing = _mm256_or_si256(line, _mm256_cmpeq_epi64(_mm256_and_si256(ls1b, pinned), _mm256_setzero_si256()));
+        landing = _mm256_and_si256(_mm256_and_si256(landing, allowed), batch_not_empty(ls1b));
+
+        // count pawn moves
+        if (piece == P)
+        {
+            count = _mm256_add_epi64(count, batch_count_pawn_moves(ls1b, empty, enemy, landing));
+            continue;
+        }
+
+        // look up piece attacks
+        __m256i attacks = (piece == B) ? batch_slider_attacks(bishop, square, occupancy) :
+                          (piece == R) ? batch_slider_attacks(rook, square, occupancy) :
+                          _mm256_i64gather_epi64((const long long *)knight_attacks, square, 8);
+
+        // count moves
+        count = _mm256_add_epi64(count, batch_count_bits(_mm256_and_si256(attacks, landing)));
+    }
+
+    // return move counts
+    return count;
+}
+
+// count legal moves of 4 batch positions starting at index (lanes set in fallback need generate_moves)
+static inline __m256i count_batch_lanes(position_batch *batch, int index, int *fallback) {
+
+    // init piece bitboards & occupancies
+    __m256i us[6], them[6];
+    __m256i own = _mm256_setzero_si256(), enemy = _mm256_setzero_si256();
+    for (int piece = P; piece <= K; piece++)
+    {
+        us[piece] = _mm256_load_si256((const __m256i *)&batch->pieces[0][piece][index]);
+        them[piece] = _mm256_load_si256((const __m256i *)&batch->pieces[1][piece][index]);
+        own = _mm256_or_si256(own, us[piece]);
+        enemy = _mm256_or_si256(enemy, them[piece]);
+    }
+    __m256i occupancy = _mm256_or_si256(own, enemy);
+    __m256i empty = _mm256_xor_si256(occupancy, _mm256_set1_epi64x(-1));
+    __m256i king = us[K];
+    __m256i king_square = batch_ls1b_index(king);
+
+    // init enemy sliders
+    __m256i enemy_rooks = _mm256_or_si256(them[R], them[Q]);
+    __m256i enemy_bishops = _mm256_or_si256(them[B], them[Q]);
+
+    // init squares attacked by the opponent (pawns capture towards rank 1, king doesn't block rays behind it)
+    __m256i attacked = _mm256_or_si256(batch_shift(them[P], 7, not_h_file), batch_shift(them[P], 9, not_a_file));
+    attacked = _mm256_or_si256(attacked, _mm256_or_si256(batch_knight_attacks(them[N]), batch_king_attacks(them[K])));
+    attacked = _mm256_or_si256(attacked, batch_sliders_attacks(enemy_rooks, enemy_bishops, _mm256_or_si256(empty, king)));
+
+    // init enemy pawns & knights giving check
+    __m256i checkers = _mm256_or_si256(_mm256_and_si256(batch_knight_attacks(king), them[N]),
+                                       _mm256_and_si256(_mm256_or_si256(batch_shift(king, -9, not_h_file), batch_shift(king, -7, not_a_file)), them[P]));
+
+    // init pinned pieces of the side to move (& enemy sliders giving check)
+    __m256i pinned = _mm256_or_si256(_mm256_or_si256(batch_pinned_pieces(king, empty, own, enemy_rooks, 1, not_a_file, &checkers),
+                                                     batch_pinned_pieces(king, empty, own, enemy_rooks, 8, ~0ULL, &checkers)),
+                                     _mm256_or_si256(batch_pinned_pieces(king, empty, own, enemy_rooks, -1, not_h_file, &checkers),
+                                                     batch_pinned_pieces(king, empty, own, enemy_rooks, -8, ~0ULL, &checkers)));
+    pinned = _mm256_or_si256(pinned, _mm256_or_si256(_mm256_or_si256(batch_pinned_pieces(king, empty, own, enemy_bishops, 9, not_a_file, &checkers),
+                                                                     batch_pinned_pieces(king, empty, own, enemy_bishops, 7, not_h_file, &checkers)),
+                                                     _mm256_or_si256(batch_pinned_pieces(king, empty, own, enemy_bishops, -9, not_h_file, &checkers),
+                                                                     batch_pinned_pieces(king, empty, own, enemy_bishops, -7, not_a_file, &checkers))));
+
+    // init squares non king moves must land on (any square, block/capture single checker, none on double check)
+    __m256i between = _mm256_i64gather_epi64((const long long *)between_masks, _mm256_add_epi64(_mm256_slli_epi64(king_square, 6), batch_ls1b_index(checkers)), 8);
+    __m256i single_check = _mm256_cmpeq_epi64(_mm256_and_si256(checkers, _mm256_sub_epi64(checkers, _mm256_set1_epi64x(1))), _mm256_setzero_si256());
+    __m256i check_mask = _mm256_blendv_epi8(_mm256_setzero_si256(), _mm256_or_si256(checkers, between), single_check);
+    check_mask = _mm256_or_si256(check_mask, _mm256_cmpeq_epi64(checkers, _mm256_setzero_si256()));
+
+    // lanes with an enpassant capture available are left to generate_moves (it may expose the king)
+    __m256i enpassant = _mm256_load_si256((const __m256i *)&batch->enpassant[index]);
+    enpassant = _mm256_and_si256(enpassant, _mm256_or_si256(batch_shift(us[P], -9, not_h_file), batch_shift(us[P], -7, not_a_file)));
+    *fallback = _mm256_movemask_pd(_mm256_castsi256_pd(batch_not_empty(enpassant)));
+
+    // pawn moves (pinned pawns piece by piece)
+    __m256i count = batch_count_pawn_moves(_mm256_andnot_si256(pinned, us[P]), empty, enemy, check_mask);
+    count = _mm256_add_epi64(count, batch_count_piece_moves(_mm256_and_si256(pinned, us[P]), P, check_mask, empty, enemy, pinned, king_square));
+
+    // king moves to squares not attacked
+    __m256i targets = _mm256_xor_si256(own, _mm256_set1_epi64x(-1));
+    count = _mm256_add_epi64(count, batch_count_bits(_mm256_andnot_si256(attacked, _mm256_and_si256(batch_king_attacks(king), targets))));
+
+    // castling (rights, not in check, empty squares between king & rook, king passes & lands on squares not attacked)
+    __m256i castle = _mm256_and_si256(_mm256_load_si256((const __m256i *)&batch->castle[index]), _mm256_cmpeq_epi64(checkers, _mm256_setzero_si256()));
+    __m256i king_side = _mm256_and_si256(_mm256_or_si256(occupancy, attacked), _mm256_set1_epi64x((1ULL << f1) | (1ULL << g1)));
+    __m256i queen_side = _mm256_or_si256(_mm256_and_si256(occupancy, _mm256_set1_epi64x((1ULL << b1) | (1ULL << c1) | (1ULL << d1))),
+                                         _mm256_and_si256(attacked, _mm256_set1_epi64x((1ULL << c1) | (1ULL << d1))));
+    king_side = _mm256_and_si256(_mm256_cmpeq_epi64(king_side, _mm256_setzero_si256()), _mm256_and_si256(castle, _mm256_set1_epi64x(wk)));
+    queen_side = _mm256_and_si256(_mm256_cmpeq_epi64(queen_side, _mm256_setzero_si256()), _mm256_srli_epi64(_mm256_and_si256(castle, _mm256_set1_epi64x(wq)), 1));
+    count = _mm256_add_epi64(count, _mm256_add_epi64(king_side, queen_side));
+
+    // knights (pinned knights can't move) & sliders piece by piece
+    targets = _mm256_and_si256(targets, check_mask);
+    count = _mm256_add_epi64(count, batch_count_piece_moves(_mm256_andnot_si256(pinned, us[N]), N, targets, empty, enemy, pinned, king_square));
+    count = _mm256_add_epi64(count, batch_count_piece_moves(_mm256_or_si256(us[B], us[Q]), B, targets, empty, enemy, pinned, king_square));
+    count = _mm256_add_epi64(count, batch_count_piece_moves(_mm256_or_si256(us[R], us[Q]), R, targets, empty, enemy, pinned, king_square));
+
+    // return legal move counts
+    return count;
+}
+
+#endif
+
+// count legal moves of all batch positions
+void count_batch_moves(position_batch *batch, int *counts) {
+
+    // init position index
+    int index = 0;
+
+#ifdef USE_AVX2
+    // loop over 4 positions at once
+    for (; index + batch_lanes <= batch->count; index += batch_lanes)
+    {
+        // count lanes' legal moves
+        int fallback;
+        U64 lanes[batch_lanes] __attribute__((aligned(32)));
+        _mm256_store_si256((__m256i *)lanes, count_batch_lanes(batch, index, &fallback));
+
+        // store counts (fallback lanes use the regular move generator)
+        for (int lane = 0; lane < batch_lanes; lane++)
+            counts[index + lane] = (fallback & (1 << lane)) ? count_batch_position(batch, index + lane) : (int)lanes[lane];
+    }
+#endif
+
+    // count remaining positions with the regular move generator
+    for (; index < batch->count; index++)
+        counts[index] = count_batch_position(batch, index);
+}
+
+/*************************************************\
+===================================================
+                Perft Test
+===================================================
+\*************************************************/
+
+// get monotonic time in microseconds (unaffected by wall clock adjustments)
+U64 get_time_us()
+{
+    #ifdef WIN64
+        LARGE_INTEGER counter, frequency;
+        QueryPerformanceCounter(&counter);
+        QueryPerformanceFrequency(&frequency);
+        return (U64)(counter.QuadPart / frequency.QuadPart) * 1000000 +
+               (U64)(counter.QuadPart % frequency.QuadPart) * 1000000 / frequency.QuadPart;
+    #else
+        struct timespec time_value;
+        clock_gettime(CLOCK_MONOTONIC, &time_value);
+        return (U64)time_value.tv_sec * 1000000 + time_value.tv_nsec / 1000;
+    #endif
+}
+
+// get monotonic time in milliseconds
+long get_time_ms()
+{
+    return get_time_us() / 1000;
+}
+
+// perft driver (returns leaf nodes: number of positions reached during testing of the move generator at a given depth)
+static inline U64 perft_driver(position *pos, int depth)
+{
+    // reccursion escape condition
+    if (depth == 0)
+        // count reached position
+        return 1;
+    
+    // leaf nodes reached from current position
+    U64 nodes = 0;
+    
+    // create move list instance
+    moves move_list[1];
+    
+    // generate moves
+    generate_moves(pos, move_list);
+
+#ifdef DEBUG
+    // make sure staged move generation adds up to all moves
+    check_stage_moves(pos, move_list);
+#endif
+    
+        // loop over generated moves
+    for (int move_count = 0; move_count < move_list->count; move_count++)
+    {   
+#ifndef MAKE_UNMAKE
+        // preserve board state
+        copy_board(pos);
+#endif
+        
+        // make move
+        if (!make_move(pos, move_list->moves[move_count].move, all_moves))
+            // skip to the next move
+            continue;
+        
+        // call perft driver recursively
+        nodes += perft_driver(pos, depth - 1);
+        
+        // take back
+#ifdef MAKE_UNMAKE
+        unmake_move(pos, move_list->moves[move_count].move);
+#else
+        take_back(pos);
+#endif
+    }
+    
+    // return leaf nodes
+    return nodes;
+}
+
+// bulk counting perft driver (legal move generator: leaf moves are counted without making them)
+static inline U64 perft_bulk(position *pos, int depth)
+{
+    // reccursion escape condition
+    if (depth == 0)
+        // count reached position
+        return 1;
+
+    // create move list instance
+    moves move_list[1];
+
+    // generate legal moves
+    generate_moves(pos, move_list);
+
+#ifdef DEBUG
+    // make sure staged move generation adds up to all moves
+    check_stage_moves(pos, move_list);
+#endif
+
+    // every legal move reaches a leaf node
+    if (depth == 1)
+        return move_list->count;
+
+    // leaf nodes reached from current position
+    U64 nodes = 0;
+
+    // loop over generated moves
+    for (int move_count = 0; move_count < move_list->count; move_count++)
+    {
+#ifndef MAKE_UNMAKE
+        // preserve board state
+        copy_board(pos);
+#endif
+
+        // make move
+        make_move(pos, move_list->moves[move_count].move, all_moves);
+
+        // call bulk perft driver recursively
+        nodes += perft_bulk(pos, depth - 1);
+
+        // take back
+#ifdef MAKE_UNMAKE
+        unmake_move(pos, move_list->moves[move_count].move);
+#else
+        take_back(pos);
+#endif
+    }
+
+    // return leaf nodes
+    return nodes;
+}
+
+// perft hash entry (leaf nodes of a position's subtree at given depth)
+typedef struct {
+    // full hash key XOR data (entries torn by concurrent perft threads fail verification)
+    U64 check;
+
+    // subtree leaf nodes (low 56 bits) & depth (high 8 bits, 0 for empty entries)
+    U64 data;
+} perft_entry;
+
+// perft hash table & it's size in entries
+perft_entry *perft_table = NULL;
+U64 perft_table_entries = 0;
+
+// perft statistics (kept per thread, summed up after the run)
+typedef struct {
+    // hash probes & hits
+    U64 probes;
+    U64 hits;
+
+    // leaf nodes taken from hits (not searched again)
+    U64 hit_nodes;
+} perft_stats;
+
+// init perft hash table of the given size in MB (0 MB disables hashed perft)
+void init_perft_table(int mb)
+{
+    // free previous table
+    free(perft_table);
+    perft_table = NULL;
+    perft_table_entries = 0;
+
+    // hashed perft disabled
+    if (mb <= 0)
+        return;
+
+    // allocate cleared table
+    U64 entries = (U64)mb * 1024 * 1024 / sizeof(perft_entry);
+    perft_table = calloc(entries, sizeof(perft_entry));
+
+    // allocation failed
+    if (perft_table == NULL)
+    {
+        printf("     Perft hash: failed to allocate %d MB\n", mb);
+        return;
+    }
+
+    // init table size
+    perft_table_entries = entries;
+}
+
+// hashed perft driver (bulk counting, subtree leaf nodes are cached by hash key & depth)
+static U64 perft_hashed(position *pos, int depth, perft_stats *stats)
+{
+    // reccursion escape condition
+    if (depth == 0)
+        // count reached position
+        return 1;
+
+    // init hash entry (depth 1 subtrees are cheaper to count than to look up)
+    perft_entry *entry = NULL;
+
+    // probe perft hash table
+    if (depth > 1)
+    {
+        entry = &perft_table[pos->hash_key % perft_table_entries];
+        stats->probes++;
+
+        // read entry once (other threads may be writing it)
+        U64 check = __atomic_load_n(&entry->check, __ATOMIC_RELAXED);
+        U64 data = __atomic_load_n(&entry->data, __ATOMIC_RELAXED);
+
+        // same position & depth searched before
+        if ((check ^ data) == pos->hash_key && (int)(data >> 56) == depth)
+        {
+            stats->hits++;
+            stats->hit_nodes += data & 0xffffffffffffffULL;
+            return data & 0xffffffffffffffULL;
+        }
+    }
+
+    // create move list instance
+    moves move_list[1];
+
+    // generate legal moves
+    generate_moves(pos, move_list);
+
+#ifdef DEBUG
+    // make sure staged move generation adds up to all moves
+    check_stage_moves(pos, move_list);
+#endif
+
+    // every legal move reaches a leaf node
+    if (depth == 1)
+        return move_list->count;
+
+    // leaf nodes reached from current position
+    U64 nodes = 0;
+
+    // loop over generated moves
+    for (int move_count = 0; move_count < move_list->count; move_count++)
+    {
+#ifndef MAKE_UNMAKE
+        // preserve board state
+        copy_board(pos);
+#endif
+
+        // make move
+        make_move(pos, move_list->moves[move_count].move, all_moves);
+
+        // call hashed perft driver recursively
+        nodes += perft_hashed(pos, depth - 1, stats);
+
+        // take back
+#ifdef MAKE_UNMAKE
+        unmake_move(pos, move_list->moves[move_count].move);
+#else
+        take_back(pos);
+#endif
+    }
+
+    // store subtree leaf nodes (always replace)
+    U64 data = nodes | ((U64)depth << 56);
+    __atomic_store_n(&entry->check, pos->hash_key ^ data, __ATOMIC_RELAXED);
+    __atomic_store_n(&entry->data, data, __ATOMIC_RELAXED);
+
+    // return leaf nodes
+    return nodes;
+}
+
+// perft job (subtree of a root move or, for narrow roots, of a root move & reply)
+typedef struct {
+    // root move index within root moves
+    int root;
+
+    // reply move (0 if job covers the whole root move subtree)
+    int reply;
+
+    // subtree leaf nodes
+    U64 nodes;
+} perft_job;
+
+// perft jobs shared by perft threads
+typedef struct {
+    // root position, depth & moves
+    position *pos;
+    int depth;
+    moves root_moves;
+
+    // count subtrees with perft hash table (bulk counting otherwise)
+    int hashed;
+
+    // jobs & next job to pick up
+    perft_job *jobs;
+    int jobs_count;
+    int next_job;
+} perft_jobs;
+
+// perft thread state (shared jobs & thread's own statistics)
+typedef struct {
+    perft_jobs *jobs;
+    perft_stats stats;
+} perft_thread;
+
+// perft thread (picks up jobs until there are none left)
+thread_function(perft_search_thread) {
+
+    // init thread state & shared jobs
+    perft_thread *thread = (perft_thread *)argument;
+    perft_jobs *jobs = thread->jobs;
+
+    // init thread's position
+    position *pos = malloc(sizeof(position));
+
+    // pick up next job
+    int job;
+    while ((job = __atomic_fetch_add(&jobs->next_job, 1, __ATOMIC_RELAXED)) < jobs->jobs_count)
+    {
+        // init current job & remaining depth
+        perft_job *current = &jobs->jobs[job];
+        int depth = jobs->depth - 1;
+
+        // reset thread's position to the root
+        memcpy(pos, jobs->pos, sizeof(position));
+
+        // make root move (& reply)
+        make_move(pos, jobs->root_moves.moves[current->root].move, all_moves);
+        if (current->reply)
+        {
+            make_move(pos, current->reply, all_moves);
+            depth--;
+        }
+
+        // count subtree leaf nodes
+        current->nodes = jobs->hashed ? perft_hashed(pos, depth, &thread->stats) : perft_bulk(pos, depth);
+    }
+
+    // free thread's position
+    free(pos);
+
+    return 0;
+}
+
+// run all perft jobs on given number of threads (returns elapsed time in microseconds)
+static U64 run_perft_jobs(perft_jobs *jobs, perft_thread *thread_states, int threads_count) {
+
+    // init start time & first job
+    U64 start = get_time_us();
+    jobs->next_job = 0;
+
+    // start perft threads & wait for them to finish
+    thread_handle threads[max_threads];
+    for (int thread = 0; thread < threads_count; thread++)
+    {
+        thread_states[thread] = (perft_thread){ jobs, { 0, 0, 0 } };
+        thread_start(&threads[thread], perft_search_thread, &thread_states[thread]);
+    }
+    for (int thread = 0; thread < threads_count; thread++)
+        thread_join(threads[thread]);
+
+    // return elapsed time
+    return get_time_us() - start;
+}
+
+// perft test output modes (report, machine-readable UCI divide, report & reference reruns)
+enum { perft_report, perft_uci, perft_compare };
+
+// perft test (per root move breakdown, root moves are split into jobs run by given number of threads)
+void perft_test(position *pos, int depth, int threads_count, int mode)
+{
+    // machine-readable divide ("<move>: <nodes>" lines & "Nodes searched: <nodes>") for UCI "go perft"
+    int uci = mode == perft_uci;
+    if (!uci)
+        printf("\n     Performance test\n\n");
+
+    // clamp depth (root moves are always made) & thread count
+    if (depth < 1) depth = 1;
+    if (threads_count < 1) threads_count = 1;
+    if (threads_count > max_threads) threads_count = max_threads;
+
+    // init shared jobs
+    perft_jobs jobs[1];
+    jobs->pos = pos;
+    jobs->depth = depth;
+    jobs->hashed = perft_table != NULL;
+    jobs->jobs_count = 0;
+
+    // generate root moves
+    generate_moves(pos, &jobs->root_moves);
+
+    // split root moves into replies when there are too few of them to keep all threads busy
+    int split = threads_count > 1 && depth > 2 && jobs->root_moves.count < threads_count * 4;
+
+    // allocate jobs (up to 256 replies per root move)
+    jobs->jobs = malloc(sizeof(perft_job) * (jobs->root_moves.count * (split ? 256 : 1) + 1));
+
+    // loop over root moves
+    for (int root = 0; root < jobs->root_moves.count; root++)
+    {
+        // whole root move subtree
+        if (!split)
+        {
+            jobs->jobs[jobs->jobs_count++] = (perft_job){ root, 0, 0 };
+            continue;
+        }
+
+        // init position after root move
+        position *child = malloc(sizeof(position));
+        memcpy(child, pos, sizeof(position));
+        make_move(child, jobs->root_moves.moves[root].move, all_moves);
+
+        // generate replies
+        moves replies[1];
+        generate_moves(child, replies);
+        free(child);
+
+        // no replies (checkmate or stalemate), leaves nothing to split
+        if (replies->count == 0)
+            jobs->jobs[jobs->jobs_count++] = (perft_job){ root, 0, 0 };
+
+        // one job per reply
+        for (int reply = 0; reply < replies->count; reply++)
+            jobs->jobs[jobs->jobs_count++] = (perft_job){ root, replies->moves[reply].move, 0 };
+    }
+
+    // run jobs & init elapsed time (microseconds, job splitting isn't timed)
+    static perft_thread thread_states[max_threads];
+    U64 time = run_perft_jobs(jobs, thread_states, threads_count);
+
+    // leaf nodes (number of positions reached during testing  of the move generator at a given depth)
+    U64 nodes = 0;
+
+    // loop over root moves
+    for (int root = 0, job = 0; root < jobs->root_moves.count; root++)
+    {
+        // sum up root move's jobs
+        U64 old_nodes = 0;
+        for (; job < jobs->jobs_count && jobs->jobs[job].root == root; job++)
+            old_nodes += jobs->jobs[job].nodes;
+
+        // cummulative nodes
+        nodes += old_nodes;
+
+        // print move
+        int move = jobs->root_moves.moves[root].move;
+        if (uci)
+        {
+            printf("%s%s", square_to_coordinates[get_move_source(move)], square_to_coordinates[get_move_target(move)]);
+            if (get_move_promotion(move)) printf("%c", get_move_promoted_char(move));
+            printf(": %llu\n", old_nodes);
+        }
+        else
+            printf("     move: %s%s%c  nodes: %llu\n", square_to_coordinates[get_move_source(move)],
+                                                      square_to_coordinates[get_move_target(move)],
+                                                      get_move_promotion(move) ? get_move_promoted_char(move) : ' ',
+                                                      old_nodes);
+    }
+
+    // print UCI total (stable format for external perft diff tools)
+    if (uci)
+    {
+        printf("\nNodes searched: %llu\n\n", nodes);
+        free(jobs->jobs);
+        return;
+    }
+
+    // print results
+    printf("\n    Depth: %d\n", depth);
+    printf("    Nodes: %llu\n", nodes);
+    printf("     Time: %llu\n", time / 1000);
+    printf("      NPS: %llu\n", time ? nodes * 1000000 / time : nodes);
+    printf("  Threads: %d%s\n\n", threads_count, split ? " (split at ply 2)" : "");
+
+    // sum up threads' statistics
+    perft_stats stats = { 0, 0, 0 };
+    for (int thread = 0; thread < threads_count; thread++)
+    {
+        stats.probes += thread_states[thread].stats.probes;
+        stats.hits += thread_states[thread].stats.hits;
+        stats.hit_nodes += thread_states[thread].stats.hit_nodes;
+    }
+
+    // print perft hash statistics
+    if (perft_table)
+        printf("     Hash: %llu MB  probes: %llu  hits: %llu  hit rate: %.1f%%  nodes from hash: %.1f%%\n\n",
+               perft_table_entries * sizeof(perft_entry) / (1024 * 1024), stats.probes, stats.hits,
+               stats.probes ? 100.0 * stats.hits / stats.probes : 0.0, nodes ? 100.0 * stats.hit_nodes / nodes : 0.0);
+
+    // on request rerun same jobs on 1 thread to report scaling (hash table cleared so both runs start equal)
+    if (threads_count > 1 && mode == perft_compare)
+    {
+        if (perft_table) memset(perft_table, 0, perft_table_entries * sizeof(perft_entry));
+        U64 single_time = run_perft_jobs(jobs, thread_states, 1);
+        printf("  Scaling: %.2fx over 1 thread (1 thread: %llu ms, %d threads: %llu ms)\n\n",
+               time ? (double)single_time / time : 0.0, single_time / 1000, threads_count, time / 1000);
+    }
+
+    // on request rerun same jobs without hash table to report time saved by it (costs a full unhashed perft)
+    if (perft_table && mode == perft_compare)
+    {
+        jobs->hashed = 0;
+        U64 bulk_time = run_perft_jobs(jobs, thread_states, threads_count);
+
+        // sum up bulk counted nodes (differ from hashed ones only on hash key collisions)
+        U64 bulk_nodes = 0;
+        for (int job = 0; job < jobs->jobs_count; job++)
+            bulk_nodes += jobs->jobs[job].nodes;
+
+        printf("     Bulk: %llu ms without hash  saved: %lld ms  speedup: %.2fx%s\n\n", bulk_time / 1000,
+               ((long long)bulk_time - (long long)time) / 1000, time ? (double)bulk_time / time : 0.0,
+               bulk_nodes != nodes ? "  NODES DIFFER (hash collision)" : "");
+    }
+
+    // free jobs
+    free(jobs->jobs);
+}
+
+// perft benchmark over the debug positions (compare build options NPS, bulk counting skips making leaf moves)
+void perft_bench(int bulk)
+{
+    // benchmark positions & depths
+    char *bench_names[] = { "start", "tricky", "killer", "cmk" };
+    char *bench_fens[] = { start_position, tricky_position, killer_position, cmk_position };
+    int bench_depths[] = { 5, 4, 4, 4 };
+
+    // benchmark position instance
+    position pos[1];
 
-                    else
-                    {
-                        // capture move
-                        add_move(move_list, encode_move(source_square, target_square, piece, 0, 1, 0, 0, 0));
+    // total nodes & time
+    U64 total_nodes = 0;
+    long total_time = 0;
 
-                    }
-                    
-                    // pop ls1b in current attacks set
-                    pop_bit(attacks, target_square);
-                }
+    // print board state handling & leaf counting mode
+    #ifdef MAKE_UNMAKE
+        printf("\n     Perft benchmark (make/unmake%s)\n\n", bulk ? ", bulk counting" : "");
+    #else
+        printf("\n     Perft benchmark (copy/make%s)\n\n", bulk ? ", bulk counting" : "");
+    #endif
 
-                // pop ls1b of the current piece bitboard
-                pop_bit(bitboard, source_square);
-            }
-            
-        }
+    // loop over benchmark positions
+    for (int index = 0; index < 4; index++)
+    {
+        // init position
+        parse_fen(pos, bench_fens[index]);
 
-        // generate queen moves
-        if ((side == white) ? piece == Q : piece == q)
-        {
-            // loop over source square of piece bitboard copy
-            while (bitboard)
-            {
-                // init source square and ls1b base on init bitboard from the if condition
-                source_square = get_ls1b_index(bitboard);
+        // init start time
+        long start = get_time_ms();
 
-                // init piece attacks in order to get set of target square (if tertiary with bitwise ~ NOT)
-                attacks = get_queen_attacks(source_square, occupancies[both]) & ((side == white) ? ~occupancies[white] : ~occupancies[black]);
+        // run perft
+        U64 nodes = bulk ? perft_bulk(pos, bench_depths[index]) : perft_driver(pos, bench_depths[index]);
 
-                // loop over target squares available from generated attacks
-                while (attacks)
-                {
-                    // init target square
-                    target_square = get_ls1b_index(attacks);
+        // init elapsed time
+        long time = get_time_ms() - start;
 
-                    // quiet move
-                    if (!get_bit(((side == white) ? occupancies[black] : occupancies[white]), target_square))
-                    {
-                        add_move(move_list, encode_move(source_square, target_square, piece, 0, 0, 0, 0, 0));
-                    }
+        // accumulate totals
+        total_nodes += nodes;
+        total_time += time;
 
-                    else
-                    {
-                        // capture move
-                        add_move(move_list, encode_move(source_square, target_square, piece, 0, 1, 0, 0, 0));
-                    }
-                    
-                    // pop ls1b in current attacks set
-                    pop_bit(attacks, target_square);
-                }
+        // print position results
+        printf("     %-7s depth: %d  nodes: %10llu  time: %6ld  nps: %llu\n", bench_names[index], bench_depths[index],
+                                                                           nodes, time, time ? nodes * 1000 / time : nodes);
+    }
 
-                // pop ls1b of the current piece bitboard
-                pop_bit(bitboard, source_square);
-            }
-            
-        }
+    // print total results
+    printf("\n     Nodes: %llu\n", total_nodes);
+    printf("      Time: %ld\n", total_time);
+    printf("       NPS: %llu\n\n", total_time ? total_nodes * 1000 / total_time : total_nodes);
+}
 
-        // generate king moves
-        if ((side == white) ? piece == K : piece == k)
-        {
-            // loop over source square of piece bitboard copy
-            while (bitboard)
-            {
-                // init source square and ls1b base on init bitboard from the if condition
-                source_square = get_ls1b_index(bitboard);
+// batch benchmark state (leaf positions are timed a batch at a time, so both paths count the same hot positions)
+typedef struct {
+    // collected leaf positions
+    position positions[batch_size];
+    int count;
 
-                // init piece attacks in order to get set of target square (if tertiary with bitwise ~ NOT)
-                attacks = king_attacks[source_square] & ((side == white) ? ~occupancies[white] : ~occupancies[black]);
+    // counted positions, legal moves & count mismatches
+    U64 positions_total;
+    U64 moves_total;
+    U64 mismatches;
 
-                // loop over target squares available from generated attacks
-                while (attacks)
-                {
-                    // init target square
-                    target_square = get_ls1b_index(attacks);
+    // generate_moves & count_batch_moves time (microseconds)
+    U64 generate_time;
+    U64 batch_time;
+} batch_bench_state;
 
-                    // quiet move
-                    if (!get_bit(((side == white) ? occupancies[black] : occupancies[white]), target_square))
-                    {
-                        add_move(move_list, encode_move(source_square, target_square, piece, 0, 0, 0, 0, 0));
-                    }
+// count collected positions' legal moves with generate_moves & count_batch_moves
+static void batch_bench_positions(batch_bench_state *state) {
 
-                    else
-                    {
-                        // capture move
-                        add_move(move_list, encode_move(source_square, target_square, piece, 0, 1, 0, 0, 0));
-                    }
-                    
-                    // pop ls1b in current attacks set
-                    pop_bit(attacks, target_square);
-                }
+    // legal move counts of both paths
+    int generate_counts[batch_size];
+    int batch_counts[batch_size];
 
-                // pop ls1b of the current piece bitboard
-                pop_bit(bitboard, source_square);
-            }
-            
-        }
+    // count moves with the regular move generator
+    U64 start = get_time_us();
+    for (int index = 0; index < state->count; index++)
+    {
+        moves move_list[1];
+        generate_moves(&state->positions[index], move_list);
+        generate_counts[index] = move_list->count;
+    }
+    state->generate_time += get_time_us() - start;
+
+    // count moves of the same positions batched (filling the batch is part of the cost)
+    static position_batch batch[1];
+    start = get_time_us();
+    batch->count = 0;
+    for (int index = 0; index < state->count; index++)
+        add_batch_position(batch, &state->positions[index]);
+    count_batch_moves(batch, batch_counts);
+    state->batch_time += get_time_us() - start;
+
+    // compare counts
+    for (int index = 0; index < state->count; index++)
+    {
+        state->moves_total += generate_counts[index];
+        state->mismatches += generate_counts[index] != batch_counts[index];
     }
-    
-}
-
-/*************************************************\
-===================================================
-                Perft Test
-===================================================
-\*************************************************/
 
-// get time in milliseconds
-int get_time_ms()
-{
-    #ifdef WIN64
-        return GetTickCount();
-    #else
-        struct timeval time_value;
-        gettimeofday(&time_value, NULL);
-        return time_value.tv_sec * 1000 + time_value.tv_usec / 1000;
-    #endif
+    // empty collected positions
+    state->positions_total += state->count;
+    state->count = 0;
 }
 
-// leaf nodes (number of positions reached during testing  of the move generator at a given depth)
-long nodes;
+// collect leaf positions at given depth (benchmarked whenever a batch worth of them is collected)
+static void batch_bench_walk(batch_bench_state *state, position *pos, int depth) {
 
-// perft driver
-static inline void perft_driver(int depth)
-{
-    // reccursion escape condition
+    // leaf position
     if (depth == 0)
     {
-        // increment nodes count (count reached positions)
-        nodes++;
+        memcpy(&state->positions[state->count++], pos, sizeof(position));
+        if (state->count == batch_size) batch_bench_positions(state);
         return;
     }
-    
-    // create move list instance
-    moves move_list[1];
-    
+
     // generate moves
-    generate_moves(move_list);
-    
-        // loop over generated moves
+    moves move_list[1];
+    generate_moves(pos, move_list);
+
+    // loop over generated moves
     for (int move_count = 0; move_count < move_list->count; move_count++)
-    {   
+    {
+#ifndef MAKE_UNMAKE
         // preserve board state
-        copy_board();
-        
+        copy_board(pos);
+#endif
+
         // make move
-        if (!make_move(move_list->moves[move_count], all_moves))
-            // skip to the next move
-            continue;
-        
-        // call perft driver recursively
-        perft_driver(depth - 1);
-        
+        make_move(pos, move_list->moves[move_count].move, all_moves);
+
+        // collect child's leaf positions
+        batch_bench_walk(state, pos, depth - 1);
+
         // take back
-        take_back();
+#ifdef MAKE_UNMAKE
+        unmake_move(pos, move_list->moves[move_count].move);
+#else
+        take_back(pos);
+#endif
+    }
+}
+
+// batched legal move counting benchmark (count_batch_moves vs generate_moves over depth 3 leaves of the debug positions)
+void batch_bench() {
+
+    // benchmark positions
+    char *bench_fens[] = { start_position, tricky_position, killer_position, cmk_position };
+
+    // benchmark state (heap allocated, a batch of positions is too big for the stack with MAKE_UNMAKE)
+    batch_bench_state *state = calloc(1, sizeof(batch_bench_state));
+
+    // print counting kernel
+    #ifdef USE_AVX2
+        printf("\n     Batch move counting benchmark (AVX2, %d lanes)\n\n", batch_lanes);
+    #else
+        printf("\n     Batch move counting benchmark (no AVX2, regular move generator per position)\n\n");
+    #endif
+
+    // loop over benchmark positions
+    for (int index = 0; index < 4; index++)
+    {
+        position pos[1];
+        parse_fen(pos, bench_fens[index]);
+        batch_bench_walk(state, pos, 3);
     }
+
+    // count remaining positions
+    if (state->count) batch_bench_positions(state);
+
+    // print results (positions per second)
+    printf("        Positions: %llu  moves: %llu  mismatches: %llu\n", state->positions_total, state->moves_total, state->mismatches);
+    printf("   generate_moves: %6llu us  %llu positions/s\n", state->generate_time,
+           state->generate_time ? state->positions_total * 1000000 / state->generate_time : state->positions_total);
+    printf("      batch count: %6llu us  %llu positions/s\n\n", state->batch_time,
+           state->batch_time ? state->positions_total * 1000000 / state->batch_time : state->positions_total);
+
+    // free benchmark state
+    free(state);
 }
 
-// perft test
-void perft_test(int depth)
+/*
+    perft suite EPD lines: FEN followed by reference leaf node counts per depth
+
+    rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - ;D1 20 ;D2 400 ;D3 8902
+*/
+
+// default perft suite max depth (run every annotated depth, perft hash entries hold depths up to 255)
+#define perft_suite_all_depths 255
+
+// run perft suite over EPD file up to max depth (returns number of failed positions, -1 if file can't be read)
+int perft_suite(char *file_name, int max_depth)
 {
-    printf("\n     Performance test\n\n");
-    
-    // create move list instance
-    moves move_list[1];
-    
-    // generate moves
-    generate_moves(move_list);
-    
-    // init start time
-    long start = get_time_ms();
-    
-    // loop over generated moves
-    for (int move_count = 0; move_count < move_list->count; move_count++)
-    {   
-        // preserve board state
-        copy_board();
-        
-        // make move
-        if (!make_move(move_list->moves[move_count], all_moves))
-            // skip to the next move
+    // open EPD file
+    FILE *file = fopen(file_name, "r");
+    if (file == NULL)
+    {
+        printf("     Perft suite: can't open %s\n", file_name);
+        return -1;
+    }
+
+    printf("\n     Perft suite %s\n\n", file_name);
+
+    // suite position instance
+    static position pos[1];
+
+    // positions, failed positions & totals
+    int positions = 0, failed = 0;
+    U64 total_nodes = 0;
+    U64 total_time = 0;
+
+    // loop over EPD lines
+    char line[2048];
+    while (fgets(line, sizeof(line), file))
+    {
+        // skip empty & comment lines
+        if (line[0] == '\n' || line[0] == '\r' || line[0] == '#')
             continue;
-        
-        // cummulative nodes
-        long cummulative_nodes = nodes;
-        
-        // call perft driver recursively
-        perft_driver(depth - 1);
-        
-        // old nodes
-        long old_nodes = nodes - cummulative_nodes;
-        
-        // take back
-        take_back();
-        
-        // print move
-        printf("     move: %s%s%c  nodes: %ld\n", square_to_coordinates[get_move_source(move_list->moves[move_count])],
-                                                 square_to_coordinates[get_move_target(move_list->moves[move_count])],
-                                                 get_move_promoted(move_list->moves[move_count]) ? promoted_pieces[get_move_promoted(move_list->moves[move_count])] : ' ',
-                                                 old_nodes);
+
+        // cut FEN from depth annotations
+        char *annotation = strchr(line, ';');
+        if (annotation == NULL)
+            continue;
+        *annotation++ = '\0';
+
+        // init position
+        parse_fen(pos, line);
+        positions++;
+
+        // position's result, nodes & time (microseconds, shallow lines take well under a millisecond)
+        int passed = 1;
+        U64 nodes = 0;
+        U64 time = 0;
+
+        // loop over ";D<depth> <nodes>" annotations
+        while (annotation != NULL)
+        {
+            // parse depth & expected leaf nodes
+            int depth;
+            U64 expected;
+            if (sscanf(annotation, " D%d %llu", &depth, &expected) == 2 && depth <= max_depth)
+            {
+                // run perft
+                perft_stats stats = { 0, 0, 0 };
+                U64 start = get_time_us();
+                U64 result = perft_table ? perft_hashed(pos, depth, &stats) : perft_bulk(pos, depth);
+                time += get_time_us() - start;
+                nodes += result;
+
+                // flag mismatch
+                if (result != expected)
+                {
+                    printf("     FAIL depth %d: expected %llu, got %llu\n", depth, expected, result);
+                    passed = 0;
+                }
+            }
+
+            // next annotation
+            annotation = strchr(annotation, ';');
+            if (annotation != NULL) annotation++;
+        }
+
+        // accumulate totals
+        failed += !passed;
+        total_nodes += nodes;
+        total_time += time;
+
+        // print position results
+        printf("     %4d %s  nodes: %12llu  time: %10.3f  nps: %10llu  %s\n", positions, passed ? "ok  " : "FAIL",
+               nodes, time / 1000.0, time ? nodes * 1000000 / time : nodes, line);
     }
-    
-    // print results
-    printf("\n    Depth: %d\n", depth);
-    printf("    Nodes: %ld\n", nodes);
-    printf("     Time: %ld\n\n", get_time_ms() - start);
+
+    // close EPD file
+    fclose(file);
+
+    // print total results
+    printf("\n     Positions: %d  passed: %d  failed: %d\n", positions, positions - failed, failed);
+    printf("         Nodes: %llu\n", total_nodes);
+    printf("          Time: %.3f\n", total_time / 1000.0);
+    printf("           NPS: %llu\n\n", total_time ? total_nodes * 1000000 / total_time : total_nodes);
+
+    // return failed positions
+    return failed;
 }
 
 /*************************************************\
@@ -2448,7 +5334,7 @@ void perft_test(int depth)
 \*************************************************/
 
 // search position
-void search_position(int depth)
+void search_position(position *pos, int depth)
 {
     // best move placeholder
     printf("bestmove d2d4\n");
@@ -2461,13 +5347,13 @@ void search_position(int depth)
 \*************************************************/
 
 // parse user/GUI move string input (e.g. "e7e8q")
-int parse_move(char *move_string)
+int parse_move(position *pos, char *move_string)
 {
     // create move list instance
     moves move_list[1];
     
     // generate moves
-    generate_moves(move_list);
+    generate_moves(pos, move_list);
     
     // parse source square
     int source_square = (move_string[0] - 'a') + (8 - (move_string[1] - '0')) * 8;
@@ -2479,13 +5365,13 @@ int parse_move(char *move_string)
     for (int move_count = 0; move_count < move_list->count; move_count++)
     {
         // init move
-        int move = move_list->moves[move_count];
+        int move = move_list->moves[move_count].move;
         
         // make sure source & target squares are available within the generated move
         if (source_square == get_move_source(move) && target_square == get_move_target(move))
         {
             // init promoted piece
-            int promoted_piece = get_move_promoted(move);
+            int promoted_piece = get_move_promoted(move, pos->side);
             
             // promoted piece is available
             if (promoted_piece)
@@ -2540,7 +5426,7 @@ int parse_move(char *move_string)
 */
 
 // parse UCI "position" command
-void parse_position(char *command)
+void parse_position(position *pos, char *command)
 {
     // shift pointer to the right where next token begins [ 9 is 'position ']
     command += 9;
@@ -2551,7 +5437,7 @@ void parse_position(char *command)
     // parse UCI "startpos" command [ strncmp is string compare.] still not sure how the checks == 0 works, if true is 0?
     if (strncmp(command, "startpos", 8) == 0)
         // init chess board with start position
-        parse_fen(start_position);
+        parse_fen(pos, start_position);
     
     // parse UCI "fen" command 
     else
@@ -2562,7 +5448,7 @@ void parse_position(char *command)
         // if no "fen" command is available within command string
         if (current_char == NULL)
             // init chess board with start position
-            parse_fen(start_position);
+            parse_fen(pos, start_position);
             
         // found "fen" substring
         else
@@ -2571,7 +5457,7 @@ void parse_position(char *command)
             current_char += 4;
             
             // init chess board with position from FEN string
-            parse_fen(current_char);
+            parse_fen(pos, current_char);
         }
     }
     
@@ -2588,7 +5474,7 @@ void parse_position(char *command)
         while(*current_char)
         {
             // parse next move
-            int move = parse_move(current_char);
+            int move = parse_move(pos, current_char);
             
             // if no more moves
             if (move == 0)
@@ -2596,7 +5482,7 @@ void parse_position(char *command)
                 break;
             
             // make move on the chess board
-            make_move(move, all_moves);
+            make_move(pos, move, all_moves);
             
             // move current character mointer to the end of current move
             while (*current_char && *current_char != ' ') current_char++;
@@ -2608,7 +5494,7 @@ void parse_position(char *command)
     }
 
     // print board
-    print_board();
+    print_board(pos);
 }
 
 /*
@@ -2617,10 +5503,13 @@ void parse_position(char *command)
     // fixed depth search
     go depth 64
 
+    // perft divide (per root move leaf nodes & "Nodes searched" total)
+    go perft 5
+
 */
 
 // parse UCI "go" command
-void parse_go(char *command)
+void parse_go(position *pos, char *command)
 {
     // init depth
     int depth = -1;
@@ -2628,6 +5517,16 @@ void parse_go(char *command)
     // init character pointer to the current depth argument
     char *current_depth = NULL;
     
+    // init character pointer to the perft depth argument
+    char *perft_depth = NULL;
+    
+    // handle perft divide ("go perft <depth>")
+    if (perft_depth = strstr(command, "perft"))
+    {
+        perft_test(pos, atoi(perft_depth + 6), get_cpu_count(), perft_uci);
+        return;
+    }
+    
     // handle fixed depth search
     if (current_depth = strstr(command, "depth"))
         //convert string to integer and assign the result value to depth
@@ -2638,7 +5537,7 @@ void parse_go(char *command)
         depth = 6;
     
     // search position
-    search_position(depth);
+    search_position(pos, depth);
 }
 
 /*
@@ -2657,6 +5556,10 @@ void uci_loop()
     // define user / GUI input buffer
     char input[2000];
     
+    // engine's own position instance (init with start position)
+    position pos[1];
+    parse_fen(pos, start_position);
+    
     // print engine info
     printf("id name BitBoardChess\n");
     printf("id author Vee\n");
@@ -2691,17 +5594,27 @@ void uci_loop()
         // parse UCI "position" command
         else if (strncmp(input, "position", 8) == 0)
             // call parse position function
-            parse_position(input);
+            parse_position(pos, input);
         
         // parse UCI "ucinewgame" command
         else if (strncmp(input, "ucinewgame", 10) == 0)
             // call parse position function
-            parse_position("position startpos");
+            parse_position(pos, "position startpos");
         
         // parse UCI "go" command
         else if (strncmp(input, "go", 2) == 0)
             // call parse go function
-            parse_go(input);
+            parse_go(pos, input);
+        
+        // parse "bench batch" command (batched vs regular legal move counting benchmark)
+        else if (strncmp(input, "bench", 5) == 0 && strstr(input, "batch"))
+            // call batch benchmark
+            batch_bench();
+        
+        // parse "bench [bulk]" command (perft benchmark over the debug positions)
+        else if (strncmp(input, "bench", 5) == 0)
+            // call perft benchmark
+            perft_bench(strstr(input, "bulk") != NULL);
         
         // parse UCI "quit" command
         else if (strncmp(input, "quit", 4) == 0)
@@ -2719,23 +5632,142 @@ void uci_loop()
     }
 }
 
+/*************************************************\
+===================================================
+                Precomputed Tables
+===================================================
+\*************************************************/
+
+#ifdef PRECOMPUTED_TABLES
+
+// attack tables, masks & hash keys (generated by "bitboardchess gentables > attack_tables.h")
+#include "attack_tables.h"
+
+#endif
+
+// print U64 table as C array definition (columns > 0 wraps rows of 2D tables in braces)
+void print_table(char *declaration, const U64 *table, int size, int columns) {
+
+    // print definition
+    printf("const %s = {", declaration);
+
+    // loop over table entries
+    for (int index = 0; index < size; index++)
+    {
+        // open row braces
+        if (columns && index % columns == 0) printf("\n    {");
+
+        // print entry (8 per line)
+        if (index % 8 == 0) printf("\n        ");
+        printf("0x%llxULL,", table[index]);
+
+        // close row braces
+        if (columns && index % columns == columns - 1) printf("\n    },");
+    }
+
+    printf("\n};\n\n");
+}
+
+#ifndef HYPERBOLA_QUINTESSENCE
+
+// print slider lookup entries pointing into the shared slider attacks table
+void print_magic_entries(char *name, const magic_entry *entries) {
+
+    // print definition
+    printf("const magic_entry %s[64] = {\n", name);
+
+    // loop over 64 board squares
+    for (int square = 0; square < 64; square++)
+        printf("    { 0x%llxULL, 0x%llxULL, slider_attacks + %d, %d },\n",
+               entries[square].mask, entries[square].magic,
+               (int)(entries[square].attacks - slider_attacks), entries[square].shift);
+
+    printf("};\n\n");
+}
+
+#endif
+
+// print all tables init_all() builds as a C header
+void generate_tables() {
+
+    printf("// attack tables, masks & hash keys, generated by \"bitboardchess gentables\" (do not edit)\n\n");
+
+    // slider attacks layout depends on the slider backend, refuse to build against another one
+#if defined(HYPERBOLA_QUINTESSENCE)
+    printf("#ifndef HYPERBOLA_QUINTESSENCE\n#error \"attack_tables.h was generated for the hyperbola quintessence backend\"\n#endif\n\n");
+#elif defined(USE_PEXT)
+    printf("#if !defined(USE_PEXT) || defined(HYPERBOLA_QUINTESSENCE)\n#error \"attack_tables.h was generated for the PEXT backend\"\n#endif\n\n");
+#else
+    printf("#if defined(USE_PEXT) || defined(HYPERBOLA_QUINTESSENCE)\n#error \"attack_tables.h was generated for the magic backend\"\n#endif\n\n");
+#endif
+
+    // leaper pieces attacks
+    print_table("U64 pawn_attacks[2][64]", pawn_attacks[0], 2 * 64, 64);
+    print_table("U64 knight_attacks[64]", knight_attacks, 64, 0);
+    print_table("U64 king_attacks[64]", king_attacks, 64, 0);
+
+#ifdef HYPERBOLA_QUINTESSENCE
+    // slider pieces line masks
+    print_table("U64 diagonal_masks[64]", diagonal_masks, 64, 0);
+    print_table("U64 anti_diagonal_masks[64]", anti_diagonal_masks, 64, 0);
+    print_table("U64 file_masks[64]", file_masks, 64, 0);
+
+    // rank attacks
+    printf("const unsigned char rank_attacks[8][64] = {\n");
+    for (int file = 0; file < 8; file++)
+    {
+        printf("    {");
+        for (int occupancy = 0; occupancy < 64; occupancy++)
+            printf(" %d,", rank_attacks[file][occupancy]);
+        printf(" },\n");
+    }
+    printf("};\n\n");
+#else
+    // slider pieces attacks & lookup entries
+    print_table("U64 slider_attacks[bishop_attacks_size + rook_attacks_size]", slider_attacks, bishop_attacks_size + rook_attacks_size, 0);
+    print_magic_entries("bishop_magics", bishop_magics);
+    print_magic_entries("rook_magics", rook_magics);
+#endif
+
+    // between & line masks
+    print_table("U64 between_masks[64][64]", between_masks[0], 64 * 64, 64);
+    print_table("U64 line_masks[64][64]", line_masks[0], 64 * 64, 64);
+
+    // hash keys
+    print_table("U64 piece_keys[12][64]", piece_keys[0], 12 * 64, 64);
+    print_table("U64 enpassant_keys[64]", enpassant_keys, 64, 0);
+    print_table("U64 castle_keys[16]", castle_keys, 16, 0);
+    printf("const U64 side_key = 0x%llxULL;\n", side_key);
+}
+
 /*************************************************\
 ===================================================
                 Init All
 ===================================================
 \*************************************************/
 
-// init all variables
+// init all variables (nothing to do when tables are precomputed)
 void init_all() {
+#ifndef PRECOMPUTED_TABLES
     // Init leaper pieces attacks
     init_leapers_attacks();
 
+#ifdef HYPERBOLA_QUINTESSENCE
+    // Init slider piece's line masks
+    init_hyperbola_masks();
+#else
     // Init slider piece's attacks
     init_sliders_attacks(bishop);
     init_sliders_attacks(rook);
+#endif
+
+    // init between & line masks (pins and check evasions)
+    init_line_masks();
 
-    // init magic numbers
-    // init_magic_numbers();
+    // init random keys for hashing purposes
+    init_random_keys();
+
+#endif
 }
 
 /*************************************************\
@@ -2744,12 +5776,47 @@ void init_all() {
 ===================================================
 \*************************************************/
 
-int main() {
+int main(int argc, char *argv[]) {
 
 
     // Init all
     init_all();
 
+    // "gentables" mode: print tables as C header (bitboardchess gentables > attack_tables.h)
+    if (argc > 1 && strcmp(argv[1], "gentables") == 0)
+    {
+        generate_tables();
+        return 0;
+    }
+
+    // "magics" mode: search magic numbers (bitboardchess magics [seed] [threads] [index reduction])
+    if (argc > 1 && strcmp(argv[1], "magics") == 0)
+    {
+        init_magic_numbers(argc > 2 ? strtoull(argv[2], NULL, 10) : 1804289383,
+                           argc > 3 ? atoi(argv[3]) : get_cpu_count(),
+                           argc > 4 ? atoi(argv[4]) : 0);
+        return 0;
+    }
+
+    // "perft" mode: perft test with per move breakdown (bitboardchess perft [depth] [hash MB] [threads] ["fen" | startpos] [compare])
+    // "compare" reruns the jobs on 1 thread (scaling factor) & without hash table to time its benefit
+    if (argc > 1 && strcmp(argv[1], "perft") == 0)
+    {
+        static position pos[1];
+        parse_fen(pos, (argc > 5 && strcmp(argv[5], "startpos")) ? argv[5] : start_position);
+        init_perft_table(argc > 3 ? atoi(argv[3]) : 0);
+        perft_test(pos, argc > 2 ? atoi(argv[2]) : 5, argc > 4 ? atoi(argv[4]) : get_cpu_count(),
+                   (argc > 6 && strcmp(argv[6], "compare") == 0) ? perft_compare : perft_report);
+        return 0;
+    }
+
+    // "perftsuite" mode: perft regression suite (bitboardchess perftsuite <file.epd> [max depth] [hash MB])
+    if (argc > 2 && strcmp(argv[1], "perftsuite") == 0)
+    {
+        init_perft_table(argc > 4 ? atoi(argv[4]) : 0);
+        return perft_suite(argv[2], argc > 3 ? atoi(argv[3]) : perft_suite_all_depths) != 0;
+    }
+
     uci_loop();
 
 